@@ -13,6 +13,8 @@
 #include "blofeld/utilities/container_formatter.h"
 
 #include "blofeld/compartmental/compartment.h"
+#include "blofeld/compartmental/compartment_batch.h"
+#include "blofeld/compartmental/seidrvmz_group.h"
 //#include "blofeld/rcpp_wrappers/compartment_wrapper.h"
 
 // #include "blofeld/rcpp_wrappers/compartment_wrapper.h"
@@ -2,11 +2,15 @@
 #define BLOFELD_COMPARTMENT_H
 
 #include <array>
+#include <vector>
 #include <numeric>
+#include <algorithm>
 #include <iostream>
 #include <typeinfo>
 #include <type_traits>
 #include <ranges>
+#include <span>
+#include <cmath>
 
 #include "./compartment_types.h"
 #include "./container.h"
@@ -33,6 +37,73 @@ namespace blofeld
       T value {};
     };
     
+    // Memo of the rates recently passed to makeProps and the resulting proportions, keyed by the rates
+    // (with one entry per set of rates, so that e.g. the rates of an update and a single makeTakeProp
+    // used between updates do not replace each other):
+    // Note: fixed capacity so that it is trivially copyable and never allocates
+    struct PropsCache
+    {
+      static constexpr int s_max_rates = 8;
+      static constexpr int s_entries = 2;
+      
+      struct Entry
+      {
+        std::array<double, s_max_rates> take_rate {};
+        std::array<double, s_max_rates> take_prop {};
+        double carry_rate = 0.0;
+        double carry_prop = 0.0;
+        int n_take = -1;        // -1 means nothing is cached
+        bool carry = false;
+        
+        // Note: exact comparison is deliberate, as any change in rate must give new proportions
+        template <blofeld::Container C>
+        [[nodiscard]] constexpr auto matches(C const& rates, bool const has_carry, double const crate) const noexcept
+          -> bool
+        {
+          if (n_take != ssize(rates) || carry != has_carry || carry_rate != crate) return false;
+          for (index i=0; i<n_take; ++i)
+          {
+            if (take_rate[i] != rates[i]) return false;
+          }
+          return true;
+        }
+      };
+      
+      std::array<Entry, s_entries> entries {};
+      int recent = 0;
+      bool frozen = false;
+      
+      constexpr auto invalidate() noexcept
+        -> void
+      {
+        for (auto& entry : entries) entry.n_take = -1;
+      }
+      
+      // The entry for these rates, or -1 if they are not cached:
+      template <blofeld::Container C>
+      [[nodiscard]] constexpr auto find(C const& rates, bool const has_carry, double const crate) const noexcept
+        -> int
+      {
+        for (int i=0; i<s_entries; ++i)
+        {
+          if (entries[i].matches(rates, has_carry, crate)) return i;
+        }
+        return -1;
+      }
+      
+      // The entry to store new rates in:  an empty entry, or (unless frozen) the least recently used,
+      // or -1 if there is none:
+      [[nodiscard]] constexpr auto vacant() const noexcept
+        -> int
+      {
+        for (int i=0; i<s_entries; ++i)
+        {
+          if (entries[i].n_take < 0) return i;
+        }
+        return frozen ? -1 : (recent + 1) % s_entries;
+      }
+    };
+    
   } // namespace internal
 
   // Note: methods are marked constexpr but using that requires a constexpr bridge!
@@ -43,7 +114,7 @@ namespace blofeld
     
   private:
     using Value = std::conditional_t<
-      s_mtype == ModelType::Deterministic,
+      s_mtype == ModelType::Deterministic || s_mtype == ModelType::Hybrid,
       double,
       std::conditional_t<
         s_mtype == ModelType::Stochastic,
@@ -59,8 +130,17 @@ namespace blofeld
       std::array<Value, s_cinfo.n>
     >;
     
-    internal::Container<Value, s_cinfo.container_type, s_cinfo.n> m_working;
-    internal::Container<Value, s_cinfo.container_type, s_cinfo.n> m_current;
+    // A single set of values, updated in place by insert/distribute/takeCarryProps:
+    // (the pre-step state is only needed as a total, so applyChanges has nothing to copy)
+    internal::Container<Value, s_cinfo.container_type, s_cinfo.n> m_values;
+
+    // Running totals as of the last applyChanges (m_total) and including changes since (m_working_total),
+    // maintained incrementally so that getTotal() is O(1):
+    Value m_total = zero();
+    Value m_working_total = zero();
+    
+    // Whether there are changes that have not yet been applied:
+    bool m_pending = false;
 
     using Bridge = decltype(s_cts)::Bridge;
     Bridge& m_bridge;
@@ -89,17 +169,55 @@ namespace blofeld
     }();
 
     // Used when size == 0:
-    internal::MaybeEmpty<Value, Resizeable<decltype(m_current)> || decltype(m_working){}.empty()> m_carry_through { };
+    internal::MaybeEmpty<Value, Resizeable<decltype(m_values)> || decltype(m_values){}.empty()> m_carry_through { };
+    
+    // Proportions from recent calls to makeProps, re-used when the same rates are seen again:
+    internal::PropsCache m_props_cache { };
+    
+    // Scratch space so that updates do not allocate:  proportions for more rates than the cache holds,
+    // and the multinomial draws in distribute for Resizeable containers (fixed sizes use std::array):
+    std::vector<double> m_scratch_props;
+    internal::MaybeEmpty<std::vector<int>, Resizeable<decltype(m_values)>> m_scratch_draws { };
+    
+    // Used for Stochastic only, with long (or resizeable) chains:  which sub-compartments are occupied, so that
+    // takeCarryProps visits only those (and the one after each that carries into it) rather than every one:
+    static constexpr bool s_sparse = s_mtype==ModelType::Stochastic && (Resizeable<decltype(m_values)> || s_cinfo.n >= 8);
+    internal::MaybeEmpty<internal::OccupancyMask<s_cinfo.n, Resizeable<decltype(m_values)>>, s_sparse> m_occupancy { };
+    
+    constexpr auto invalidateOccupancy() noexcept
+      -> void
+    {
+      if constexpr (s_sparse) m_occupancy.value.invalidate();
+    }
+    
+    // Used for Hybrid only:  sub-compartments below the threshold are integers, and the
+    // stochastic rounding needed to keep them so is accumulated as a residual:
+    struct HybridStruct
+    {
+      double threshold = 100.0;
+      Value residual = 0;
+    };
+    internal::MaybeEmpty<HybridStruct, s_mtype==ModelType::Hybrid> m_hybrid { };
+    
+    // Round a Hybrid value that is below the threshold to an integer (preserving the expectation):
+    [[nodiscard]] auto roundHybrid(double const value)
+      -> double
+    {
+      if (value <= 0.0) return 0.0;
+      double const fl = std::floor(value);
+      if (fl == value) return value;
+      return (m_bridge.runif() < (value - fl)) ? fl + 1.0 : fl;
+    }
     
     [[nodiscard]] constexpr auto setCarryThrough([[maybe_unused]] Value const value) noexcept
       -> bool
     {
-      if constexpr (Resizeable<decltype(m_current)>) {
-        if (m_current.size() == 0U) {
+      if constexpr (Resizeable<decltype(m_values)>) {
+        if (m_values.size() == 0U) {
           m_carry_through.value = value;
           return true;
         }
-      } else if constexpr (decltype(m_working){}.empty()) {
+      } else if constexpr (decltype(m_values){}.empty()) {
          m_carry_through.value = value;
          return true;
       } else {
@@ -111,9 +229,9 @@ namespace blofeld
     [[nodiscard]] constexpr auto getCarryThrough() noexcept
       -> Value
     {
-      if constexpr (Resizeable<decltype(m_current)>) {
-        if (m_current.size() == 0U) return m_carry_through.value;
-      } else if constexpr (decltype(m_working){}.empty()) {
+      if constexpr (Resizeable<decltype(m_values)>) {
+        if (m_values.size() == 0U) return m_carry_through.value;
+      } else if constexpr (decltype(m_values){}.empty()) {
         return m_carry_through.value;
       } else {
         // Fall through
@@ -121,40 +239,377 @@ namespace blofeld
       return zero();
     }
     
+    // True unless there are changes that have not yet been applied:
     [[nodiscard]] constexpr auto isDormant() const noexcept
       -> bool
     {
-      bool dormant = true;
-      
-      // std::zip is C++23:  for (const auto [value1, value2] : std::views::zip(vector1, vector2)) 
-      for (int i=0; i<std::ssize(m_current); ++i)
-      {
-        if (m_current[i] != m_working[i]) dormant = false;
+      return !m_pending;
+    }
+
+    // Running totals are compared with an absolute as well as relative tolerance, as a relative
+    // tolerance alone fails for deterministic values decaying towards zero:
+    [[nodiscard]] static constexpr auto totalsMatch(Value const a, Value const b) noexcept
+      -> bool
+    {
+      if constexpr (std::is_integral_v<Value>) {
+        return a == b;
+      } else {
+        return std::abs(a - b) <= s_cts.tol * std::max(1.0, std::abs(b));
       }
-      
-      // return m_checking.value.take_applied && m_checking.value.carry_applied && dormant;
-      return dormant;
     }
 
     constexpr auto validate()
       -> void
     {
       if constexpr (s_cts.debug) {
-        if (m_current.size() != m_working.size()) m_bridge.stop("Logic error: container sizes unequal within compartment");
+        for (auto const& val : m_values)
+        {
+          if (s_cinfo.container_type != ContainerType::BirthDeath && val < static_cast<Value>(0.0)) {
+            m_bridge.stop("Logic error: negative compartment value");
+          }
+        }
+        
+        if (!totalsMatch(m_working_total, m_total + m_checking.value.changes)) {
+          m_bridge.stop("Unequal working total={} and total={} + changes={}", m_working_total, m_total, m_checking.value.changes);
+        }
+        if (!m_pending && !totalsMatch(m_working_total, m_total)) {
+          m_bridge.stop("Logic error: working total ({}) differs from total ({}) with no changes pending", m_working_total, m_total);
+        }
+        
+        checkTotals();
+      }                  
+    }
+    
+    // Cross-check the running total against the full sum (debug only):
+    constexpr auto checkTotals() const
+      -> void
+    {
+      if constexpr (s_cts.debug) {
+        Value const working = std::accumulate(m_values.begin(), m_values.end(), zero());
+        if (!totalsMatch(m_working_total, working)) {
+          m_bridge.stop("Logic error: running working total ({}) does not match sum(values) ({})", m_working_total, working);
+        }
+      }
+    }
+
+    // Space for one draw per sub-compartment (re-using the scratch space for Resizeable containers):
+    [[nodiscard]] constexpr auto drawBuffer()
+    {
+      if constexpr (Resizeable<decltype(m_values)>) {
+        m_scratch_draws.value.resize(m_values.size());
+        return std::span<int>(m_scratch_draws.value);
+      } else {
+        // Note: clang complains that m_values.size() is not constexpr
+        // std::tuple_size_v<decltype(m_values)> works for Array but not BirthDeath
+        // Fortunately I have defined ssize as static
+        return std::array<int, decltype(m_values)::ssize()>();
+      }
+    }
+    
+    // Proportions from rates (including adjustment of carry_rate where needed), made in the cache so that they are
+    // re-used when the same rates are seen again, or in scratch space if the rates cannot be cached:
+    // Note: the span is only valid until the next call
+    struct PreparedProps
+    {
+      std::span<double const> take;
+      double carry = 0.0;
+    };
+    template <Container C, std::size_t s_nc>
+    [[nodiscard]] constexpr auto preparedProps(C const& take_rate, [[maybe_unused]] std::array<double, s_nc> const carry_rate)
+      -> PreparedProps
+    {
+      constexpr bool s_carry = s_cinfo.carry_type!=CarryType::None && s_nc!=0U;
+      index const ntake = ssize(take_rate);
+      
+      // Re-use the cached proportions for these rates, if any:
+      double const carry_key = [&](){
+        if constexpr (s_carry) {
+          return carry_rate.front();
+        } else {
+          return 0.0;
+        }
+      }();
+      bool const cacheable = ntake <= internal::PropsCache::s_max_rates;
+      if (cacheable) {
+        int const found = m_props_cache.find(take_rate, s_carry, carry_key);
+        if (found >= 0) {
+          m_props_cache.recent = found;
+          auto const& entry = m_props_cache.entries[found];
+          return { std::span<double const>(entry.take_prop.data(), ntake), entry.carry_prop };
+        }
+      }
+      int const slot = cacheable ? m_props_cache.vacant() : -1;
+      
+      // Adjust competing rates (accumulate works with size-0 arrays):
+      double const carry_adj = [&](){
+        if constexpr (!s_carry || s_cinfo.carry_type == CarryType::None) {
+          return 0.0;
+        } else if constexpr (s_cinfo.carry_type == CarryType::Sequential) {
+          return carry_rate.front() * static_cast<double>(ssize(m_values));
+        } else if constexpr (s_cinfo.carry_type == CarryType::Immediate) {
+          static_assert(false, "Logic error in makeProps: CarryType::Immediate is not yet implemented");
+          return carry_rate.front();
+        } else {
+          static_assert(false, "Logic error in makeProps: unhandled CarryType");
+        }
+      }();
+      double const sumrates = std::accumulate(take_rate.begin(), take_rate.end(), carry_adj);
+      double const adj = sumrates==0.0 ? 0.0 : ((1.0 - std::exp(-sumrates)) / sumrates);
+      
+      // Re-usable lambda:
+      auto rateToProp = [adj](double const rate) {
+        return 1.0 - std::exp(-rate * adj);
+      };
+      
+      std::span<double> const take_prop = [&](){
+        if (slot >= 0) return std::span<double>(m_props_cache.entries[slot].take_prop.data(), ntake);
+        m_scratch_props.resize(ntake);
+        return std::span<double>(m_scratch_props);
+      }();
+      for (index i=0; i<ntake; ++i)
+      {
+        take_prop[i] = rateToProp(take_rate[i]);
+      }
+      double const carry_prop = s_carry ? rateToProp(carry_adj) : 0.0;
+      
+      // Store the rates in the cache for next time:
+      if (slot >= 0) {
+        auto& entry = m_props_cache.entries[slot];
+        for (index i=0; i<ntake; ++i)
+        {
+          entry.take_rate[i] = take_rate[i];
+        }
+        entry.n_take = static_cast<int>(ntake);
+        entry.carry = s_carry;
+        entry.carry_rate = carry_key;
+        entry.carry_prop = carry_prop;
+        m_props_cache.recent = slot;
+      }
+      
+      return { take_prop, carry_prop };
+    }
+    
+    // The take and carry loop shared by takeCarryProps and the allocation-free takeCarryRates:
+    // adds the total taken by each proportion to take, and returns the total carried out (zero without carry)
+    template <bool s_carry, Container P, typename T>
+    constexpr auto applyProps(P const& take_prop, [[maybe_unused]] double const carry_prop, T& take)
+      -> Value
+    {
+      if constexpr (s_cts.debug) {
+        double sumprop = std::accumulate(take_prop.begin(), take_prop.end(), 0.0);
+        if constexpr (s_carry) sumprop += carry_prop;
+        if (sumprop > 1.0) m_bridge.stop("Invalid arguments to takeCarryProps:  sum of props exceeds 1");
+      }
+      validate();
+      
+      // Flag that an update is in progress:
+      if constexpr (s_cts.debug) {
+        m_checking.value.take_applied = false;
+        
+        // Check carry rates are applied exactly once:
+        if constexpr (s_carry) {
+          if (!m_checking.value.carry_applied) m_bridge.stop("Runtime error: attempt to call carryProp more than once without applyChanges");
+          m_checking.value.carry_applied = false;
+          /* TODO: uncomment below and update applyChanges to match
+          if constexpr (Fixedsize<P> && !P{}.empty()) {
+            m_checking.value.carry_applied = false;
+          } else if constexpr (Resizeable<P>) {
+            if (!m_values.empty()) m_checking.value.carry_applied = false;
+          }
+          */
+        }
+      }
+      
+      // Short circuit in case we are inactive:
+      if constexpr (s_carry && Fixedsize<decltype(m_values)> && decltype(m_values){}.empty()) {
+        return getCarryThrough();
+      } else if constexpr (s_carry && Resizeable<decltype(m_values)>) {
+        if (m_values.empty()) {
+          return getCarryThrough();
+        } else {
+          // Sanity check:
+          if constexpr (s_cts.debug) if (!identical(getCarryThrough(), zero())) m_bridge.stop("Logic error: non-zero carry-through for active compartment");
+        }
+      } else {
+        // Sanity check:
+        if constexpr (s_carry && s_cts.debug) if (!identical(getCarryThrough(), zero())) m_bridge.stop("Logic error: non-zero carry-through for active compartment");
+      }
+      
+      // If we have a carry prop then we need to track that:
+      auto carry = [](){
+        if constexpr (s_carry) {
+          struct { double value = zero(); } tt;
+          return tt;
+        } else {
+          struct { } tt;
+          return tt;
+        }
+      }();
+      
+      // Sparse iteration skips sub-compartments that are empty and receive no carry, as nothing would change:
+      // (the mask is only read ahead of the current sub-compartment, so it can be updated as we go)
+      index const nvals = ssize(m_values);
+      if constexpr (s_sparse) {
+        if (!m_occupancy.value.valid()) m_occupancy.value.build(m_values);
+      }
+      auto const nextIndex = [&](index const ii) -> index {
+        if constexpr (s_sparse) {
+          if constexpr (s_carry) {
+            if (carry.value != zero()) return ii+1;
+          }
+          return m_occupancy.value.next(static_cast<int>(ii+1), static_cast<int>(nvals));
+        } else {
+          return ii+1;
+        }
+      };
+      
+      // Outer loop is the sub-compartment, as we need to do everything (take and carry) together:
+      // (each sub-compartment is read before it is changed, so takes and carry see the values as they were)
+      m_pending = true;
+      for (index ii = nextIndex(-1); ii < nvals; ii = nextIndex(ii))
+      {
+        Value& cc = m_values[ii];
+        // For Deterministic we just need the total removed, for Stochastic we also need the adjusted probability:
+        auto removed = [](){
+          if constexpr (s_mtype==ModelType::Deterministic) {
+            struct {
+              Value value = zero();
+            } tt;
+            return tt;
+          } else if constexpr (s_mtype==ModelType::Stochastic) {
+            struct {
+              Value value = zero();
+              double prop = 1.0;
+            } tt;
+            return tt;
+          } else if constexpr (s_mtype==ModelType::Hybrid) {
+            // Note: random sampling (of the integer part) is only used below the threshold
+            struct {
+              Value value = zero();
+              double prop = 1.0;
+              bool sample = false;
+            } tt;
+            return tt;
+          } else {
+            static_assert(false, "Unhandled ModelType in takeCarryProps");
+          }
+        }();
+        if constexpr (s_mtype==ModelType::Hybrid) {
+          removed.sample = cc < m_hybrid.value.threshold;
+        }
+        
+        // First deal with the take proportion(s) - this could be a size-0 C:
+        for (index i=0; i<ssize(take_prop); ++i)
+        {
+          // Calculate the removal:
+          Value tt = [&](){
+            if constexpr (s_mtype==ModelType::Deterministic) {
+              // For deterministic it is just a fixed proportion:
+              return cc*take_prop[i];
+              
+            } else if constexpr (s_mtype==ModelType::Stochastic) {
+              // For stochastic we also need to adjust the probability:
+              int const val = m_bridge.rbinom(cc - removed.value, take_prop[i] / removed.prop);
+              removed.prop -= take_prop[i];
+              return val;
+              
+            } else if constexpr (s_mtype==ModelType::Hybrid) {
+              if (!removed.sample) return cc*take_prop[i];
+              int const avail = static_cast<int>(std::floor(cc - removed.value));
+              double const val = static_cast<double>(m_bridge.rbinom(std::max(avail, 0), take_prop[i] / removed.prop));
+              removed.prop -= take_prop[i];
+              return val;
+              
+            } else {
+              static_assert(false, "Logic error in takeCarryProps: unhandled ModelType");
+            }
+          }();          
+          
+          // Error and bounds checking:
+          if constexpr (s_cts.debug) {
+            if (tt < zero()) m_bridge.stop("Logic error in takeCarryProps:  tt < 0");
+            if (i >= ssize(take)) m_bridge.stop("Bounds check error in takeCarryProps:  take too small");
+          }          
+          
+          // Changes:
+          removed.value += tt;
+          take[i] += tt;
+        }
+
+        // Then deal with the carry proportion, if there is one:
+        if constexpr (s_carry) {
+        
+          // For CarryType::Immediate we need to apply any carry-forward beforehand:
+          if constexpr (s_cinfo.carry_type == CarryType::Immediate) {
+            static_assert(false, "NEEDS TESTING");
+            cc += carry.value;
+          }
+        
+          // Calculate the carry:
+          Value tt = [&](){
+            if constexpr (s_mtype==ModelType::Deterministic) {
+              // For deterministic it is just a fixed proportion:
+              return cc*carry_prop;
+              
+            } else if constexpr (s_mtype==ModelType::Stochastic) {
+              // Sanity check:
+              if constexpr (s_cts.debug) {
+                if (!identical(1.0-removed.prop, std::accumulate(take_prop.begin(), take_prop.end(), 0.0), s_cts.tol)) m_bridge.stop("Logic error in takeCarryProps:  1-removed.prop ({}) != sum(take_prop) ({})", 1.0-removed.prop, std::accumulate(take_prop.begin(), take_prop.end(), 0.0));
+              }
+              // For stochastic we also need to use the adjusted probability:
+              return m_bridge.rbinom(cc - removed.value, carry_prop / removed.prop);
+              
+            } else if constexpr (s_mtype==ModelType::Hybrid) {
+              if (!removed.sample) return cc*carry_prop;
+              int const avail = static_cast<int>(std::floor(cc - removed.value));
+              return static_cast<double>(m_bridge.rbinom(std::max(avail, 0), carry_prop / removed.prop));
+              
+            } else {
+              static_assert(false, "Logic error in takeCarryProps: unhandled ModelType");
+            }
+          }();          
+        
+          // For CarryType::Sequential we need to apply any carry-forward afterward:
+          if constexpr (s_cinfo.carry_type == CarryType::Sequential) {
+            cc += carry.value;
+          }
+          
+          // Carry forward to next subcompartment:
+          cc -= tt;
+          carry.value = tt;
+          
+          static_assert(
+            s_cinfo.carry_type == CarryType::Sequential || s_cinfo.carry_type == CarryType::Immediate, 
+            "Logic error in takeCarryProps:  unhandled CarryType"        
+          );
         
-        for (auto const& val : m_current)
-        {
-          if (val < static_cast<Value>(0.0)) {
-            m_bridge.stop("Logic error: negative compartment value");
-          }
         }
         
-        Value const current = std::accumulate(m_current.begin(), m_current.end(), zero());
-        Value const working = std::accumulate(m_working.begin(), m_working.end(), zero());
-        if (!identical(working, current + m_checking.value.changes, s_cts.tol)) {
-          m_bridge.stop("Unequal sum(working)={} and sum(current)={} + changes={}", working, current, m_checking.value.changes);
+        // Then finally apply changes to m_values:
+        cc -= removed.value;        
+        if constexpr (s_sparse) m_occupancy.value.set(static_cast<int>(ii), cc != zero());
+      }
+      
+      // The final carry value is the carry out of the compartment:
+      Value const carried = [&](){
+        if constexpr (s_carry) {
+          return static_cast<Value>(carry.value);
+        } else {
+          return zero();
         }
-      }                  
+      }();
+      
+      // Update the running total:
+      Value const removed = std::accumulate(take.begin(), take.end(), carried);
+      m_working_total -= removed;
+      
+      // Sanity check:
+      if constexpr (s_cts.debug) {
+        m_checking.value.changes -= removed;
+        validate();
+      }
+      
+      return carried;
     }
 
     Compartment() = delete;
@@ -163,16 +618,21 @@ namespace blofeld
     
     /* Constructors */
     
-    constexpr explicit Compartment(Bridge& bridge) noexcept(!s_cts.debug)
+    constexpr explicit Compartment(Bridge& bridge) noexcept(noexcept_release<s_cts>())
       : m_bridge(bridge)
     {
       validate();
     }
     
-    constexpr explicit Compartment(Bridge& bridge, Value const total) noexcept(!s_cts.debug)
+    constexpr explicit Compartment(Bridge& bridge, Value const total) noexcept(noexcept_release<s_cts>())
       : m_bridge(bridge)
     {
       distribute(total);
+      m_total = m_working_total;
+      m_pending = false;
+      if constexpr (s_cts.debug) {
+        m_checking.value.changes = zero();
+      }
       validate();
     }
     
@@ -190,7 +650,7 @@ namespace blofeld
     constexpr auto resize(int const size)
       -> void
     {
-      if constexpr (Resizeable<decltype(m_current)>) {
+      if constexpr (Resizeable<decltype(m_values)>) {
         
         if constexpr (s_cts.debug) {          
           if (size < 0) m_bridge.stop("Illegal container size < 0 (passed to resize)");
@@ -198,10 +658,19 @@ namespace blofeld
           if (!isDormant()) m_bridge.stop("It is not possible to re-size between applying rates and calling applyChanges()");
         }
         
-        const Value total = std::accumulate(m_current.begin(), m_current.end(), zero());
-        m_current.resize(size);
-        distribute(total);
-        m_working = m_current;
+        const Value total = getTotal();
+        m_props_cache.invalidate();
+        invalidateOccupancy();
+        m_values.resize(size);
+        m_values.reset();
+        m_total = zero();
+        m_working_total = zero();
+        if (size > 0) distribute(total);
+        m_total = m_working_total;
+        m_pending = false;
+        if constexpr (s_cts.debug) {
+          m_checking.value.changes = zero();
+        }
         
       } else {
         m_bridge.stop("Container is not resizeable");
@@ -210,12 +679,15 @@ namespace blofeld
     }
         
     // Reset to 0:
-    constexpr auto reset() noexcept(!s_cts.debug)
+    constexpr auto reset() noexcept(noexcept_release<s_cts>())
       -> void
     {
       validate();
-      m_current.reset();
-      m_working = m_current;
+      m_values.reset();
+      invalidateOccupancy();
+      m_total = zero();
+      m_working_total = zero();
+      m_pending = false;
       if constexpr (s_cts.debug) {
         m_checking.value.changes = zero();
         m_checking.value.take_applied = true;
@@ -225,11 +697,11 @@ namespace blofeld
     }
     
     // Add a total to the first subcompartment:
-    constexpr auto insert(Value const total) noexcept(!s_cts.debug)
+    constexpr auto insert(Value const total) noexcept(noexcept_release<s_cts>())
       -> void
     {
-      // total must be >= 0
-      if (total < zero()) {
+      // total must be >= 0 (except for BirthDeath, which is allowed to go down as well as up):
+      if (s_cinfo.container_type != ContainerType::BirthDeath && total < zero()) {
         m_bridge.stop("Invalid total < 0");
       }
       validate();
@@ -237,7 +709,10 @@ namespace blofeld
       // Shortcut if size==0:
       if(setCarryThrough(total)) return;
 
-      m_working[0] += total;
+      m_values[0] += total;
+      if constexpr (s_sparse) m_occupancy.value.set(0, m_values[0] != zero());
+      m_working_total += total;
+      m_pending = true;
       
       if constexpr (s_cts.debug) {
         m_checking.value.changes += total;
@@ -247,57 +722,73 @@ namespace blofeld
     }
 
     // Add or remove a fixed number evenly/randomly throughout:
-    constexpr auto distribute(Value const total) noexcept(!s_cts.debug)
+    constexpr auto distribute(Value total) noexcept(noexcept_release<s_cts>())
       -> void
     {
-      if constexpr (Resizeable<decltype(m_current)>) {
-        if (ssize(m_current) == 0) {
+      if constexpr (Resizeable<decltype(m_values)>) {
+        if (ssize(m_values) == 0) {
           m_bridge.stop("Unable to distribute values within an inactive compartment");
         }
       } else {
         // To restrictive as this may be within an un-followed runtime path:      
-        // static_assert(decltype(m_current){}.size() > 0U, "Unable to distribute values within a disabled compartment");
-        if (ssize(m_current) == 0) {
+        // static_assert(decltype(m_values){}.size() > 0U, "Unable to distribute values within a disabled compartment");
+        if (ssize(m_values) == 0) {
           m_bridge.stop("Unable to distribute values within a disabled compartment");
         }
       }
       
       // total must be >= -current_value
-      if (total < -std::accumulate(m_current.begin(), m_current.end(), zero())) {
+      if (total < -m_total) {
         m_bridge.stop("Invalid total < -available");
       }
       
       validate();
 
       if constexpr (s_mtype==ModelType::Deterministic) {
-        for(auto& val : m_working){
-          val += total / ssize(m_working);
+        for(auto& val : m_values){
+          val += total / ssize(m_values);
         }
       } else if constexpr (s_mtype==ModelType::Stochastic) {
         
-        auto probs = [&](){
-          if constexpr (Resizeable<decltype(m_working)>) {
-            return std::vector<double>(m_working.size());
-          } else {
-            // Note: clang complains that m_working.size() is not constexpr
-            // std::tuple_size_v<decltype(m_working)> works for Array but not BirthDeath
-            // Fortunately I have defined ssize as static
-            return std::array<double, decltype(m_working)::ssize()>();
-          }
-        }();
-        for (auto& pp : probs)
-        {
-          pp = 1.0 / ssize(m_working);
+        if (total < zero()) {
+          m_bridge.stop("Unable to remove values using distribute for a stochastic compartment");
         }
         
-        auto const inits = m_bridge.rmultinom(total, probs);
+        auto inits = drawBuffer();
+        
+        // Equal-probability multinomial is specialised by the bridge:
+        m_bridge.rmultinomEqual(total, std::span<int>(inits));
         for (index i=0; i<ssize(inits); ++i)
         {
-          m_working[i] += inits[i];
+          m_values[i] += inits[i];
+        }
+      } else if constexpr (s_mtype==ModelType::Hybrid) {
+        
+        if (total / static_cast<double>(ssize(m_values)) >= m_hybrid.value.threshold) {
+          for(auto& val : m_values){
+            val += total / ssize(m_values);
+          }
+        } else {
+          if (total < zero()) {
+            m_bridge.stop("Unable to remove values below the threshold using distribute for a hybrid compartment");
+          }
+          // Below the threshold we distribute an integer total, and record the rounding:
+          double const rounded = roundHybrid(total);
+          m_hybrid.value.residual += total - rounded;
+          total = rounded;
+          auto inits = drawBuffer();
+          m_bridge.rmultinomEqual(static_cast<int>(rounded), std::span<int>(inits));
+          for (index i=0; i<ssize(inits); ++i)
+          {
+            m_values[i] += static_cast<Value>(inits[i]);
+          }
         }
       } else {
         static_assert(false, "Unrecognised ModelType in distribute");
       }
+      invalidateOccupancy();
+      m_working_total += total;
+      m_pending = true;
           
       if constexpr (s_cts.debug) {
         m_checking.value.changes += total;
@@ -315,7 +806,7 @@ namespace blofeld
       
       // values.size() must be right, all values must be >=0, Value type must be right, we can't be mid-update
       if (!isDormant()) m_bridge.stop("It is not possible to set values between applying rates and calling applyChanges()");
-      if (values.size() != m_current.size()) m_bridge.stop("Size mis-match in provided values");
+      if (values.size() != m_values.size()) m_bridge.stop("Size mis-match in provided values");
       if (s_cts.debug) {
         for (auto val : values)
         {
@@ -323,13 +814,15 @@ namespace blofeld
         }
       }
       
-      std::copy(values.begin(), values.end(), m_current.begin());
-      m_working = m_current;
+      std::copy(values.begin(), values.end(), m_values.begin());
+      invalidateOccupancy();
+      m_total = std::accumulate(m_values.begin(), m_values.end(), zero());
+      m_working_total = m_total;
 
       validate();
     }
     
-    /* // TODO: needs a const ref accessor in m_current
+    /* // TODO: needs a const ref accessor in m_values
     // Get compartment values as a const ref:
     ReturnContainer const& getValues() const
     {
@@ -342,32 +835,57 @@ namespace blofeld
     {
       ReturnContainer rv;
       if constexpr (Resizeable<ReturnContainer>) {
-        rv.resize(m_current.size());
+        rv.resize(m_values.size());
       } else {
-        static_assert(decltype(m_current){}.size()==ReturnContainer{}.size(), "Logic error in getValues");        
+        static_assert(decltype(m_values){}.size()==ReturnContainer{}.size(), "Logic error in getValues");        
       }
-      std::copy(m_current.begin(), m_current.end(), rv.begin());
+      std::copy(m_values.begin(), m_values.end(), rv.begin());
       return rv;      
     }
     
-    // Get total by value:
+    // Get total by value (O(1) from the running total):
     [[nodiscard]] constexpr auto getTotal() const
       -> Value
     {
-      return std::accumulate(m_current.begin(), m_current.end(), zero());
+      checkTotals();
+      return m_total;
     }
         
     // Apply changes from taking rates and inserting/distruting etc:
-    constexpr auto applyChanges() noexcept(!s_cts.debug)
+    constexpr auto applyChanges() noexcept(noexcept_release<s_cts>())
       -> void
     {
       validate();
       
       if constexpr (s_cts.debug) {
-        if (m_checking.value.carry_applied) m_bridge.stop("applyChanges called consecutively without carryProp");
+        // Note: compartments without carry (n==1) may legitimately have only insert/take between calls
+        if (s_cinfo.carry_type != CarryType::None && m_checking.value.carry_applied) m_bridge.stop("applyChanges called consecutively without carryProp");
+      }
+      
+      // For Hybrid, anything that has ended up below the threshold is rounded to an integer:
+      // (the running total is re-summed here to avoid accumulating rounding error around zero)
+      if constexpr (s_mtype==ModelType::Hybrid && s_cinfo.container_type != ContainerType::BirthDeath) {
+        Value total = zero();
+        for (auto& val : m_values)
+        {
+          if (val < m_hybrid.value.threshold) {
+            double const rounded = roundHybrid(val);
+            m_hybrid.value.residual += val - rounded;
+            if constexpr (s_cts.debug) {
+              m_checking.value.changes += rounded - val;
+            }
+            val = rounded;
+          }
+          total += val;
+        }
+        m_working_total = total;
+      } else if constexpr (s_mtype==ModelType::Deterministic) {
+        // Re-sum so that the running total does not drift from the values through rounding error:
+        m_working_total = std::accumulate(m_values.begin(), m_values.end(), zero());
       }
       
-      m_current = m_working;
+      m_total = m_working_total;
+      m_pending = false;
       if constexpr (s_cts.debug) {
         m_checking.value.changes = zero();
         m_checking.value.take_applied = true;
@@ -391,7 +909,7 @@ namespace blofeld
         {
           rv[i] = val[i];
         }
-        return getValues();
+        return rv;
       }
     }
     constexpr auto setValuesV(std::vector<Value> const& values)
@@ -401,6 +919,61 @@ namespace blofeld
     }
     
     
+    /* Control of the rate-to-proportion cache used by makeProps */
+    
+    // Keep the proportions cached so far, for rates that will be used again (other rates are still
+    // converted, but do not replace them):
+    constexpr auto freezeRates() noexcept
+      -> void
+    {
+      m_props_cache.frozen = true;
+    }
+    
+    // Revert to caching the most recently used rates, and discard the cached proportions:
+    constexpr auto unfreezeRates() noexcept
+      -> void
+    {
+      m_props_cache.frozen = false;
+      m_props_cache.invalidate();
+    }
+    
+    [[nodiscard]] constexpr auto ratesFrozen() const noexcept
+      -> bool
+    {
+      return m_props_cache.frozen;
+    }
+
+
+    /* Hybrid switching between deterministic and stochastic */
+
+    // Sub-compartments with a value below the threshold are kept as integers and updated stochastically:
+    constexpr auto setHybridThreshold(double const threshold)
+      -> void
+      requires (s_mtype == ModelType::Hybrid)
+    {
+      if (threshold < 0.0) m_bridge.stop("Invalid hybrid threshold {} (must be >= 0)", threshold);
+      m_hybrid.value.threshold = threshold;
+    }
+
+    [[nodiscard]] constexpr auto getHybridThreshold() const noexcept
+      -> double
+      requires (s_mtype == ModelType::Hybrid)
+    {
+      return m_hybrid.value.threshold;
+    }
+
+    // Total removed (or, if negative, added) by rounding at the threshold since the last call:
+    // (the owner should balance this against e.g. a BirthDeath compartment)
+    [[nodiscard]] constexpr auto takeResidual() noexcept
+      -> Value
+      requires (s_mtype == ModelType::Hybrid)
+    {
+      Value const rv = m_hybrid.value.residual;
+      m_hybrid.value.residual = zero();
+      return rv;
+    }
+
+
     /* Convinience forwarding methods */
     /* EFFICIENCY CONCERNS
     // godbolt.org strongly suggests that passing a size-0 array by (const) ref is the same as by value i.e. no instructions omitted
@@ -410,15 +983,15 @@ namespace blofeld
     */    
     
     // Make a single take proportion from rate:
-    [[nodiscard]] constexpr auto makeTakeProp(double const take_rate) noexcept(!s_cts.debug)
+    [[nodiscard]] constexpr auto makeTakeProp(double const take_rate) noexcept(noexcept_release<s_cts>())
       -> double
     {
       auto [take, _] = makeProps(std::array<double, 1> { take_rate }, std::array<double, 0> {});
-      return take;
+      return take.front();
     }
 
     // Make a single carry proportion from rate:
-    [[nodiscard]] constexpr auto makeCarryProp(double const carry_rate) noexcept(!s_cts.debug)
+    [[nodiscard]] constexpr auto makeCarryProp(double const carry_rate) noexcept(noexcept_release<s_cts>())
       -> double
     {
       auto [_, carry] = makeProps(std::array<double, 0> { }, std::array<double, 1> { carry_rate });
@@ -427,7 +1000,7 @@ namespace blofeld
     
     // Take rates only:
     template <Container C>
-    [[nodiscard]] constexpr auto takeRate(C const& take_rate) noexcept(!s_cts.debug && !Resizeable<C>)
+    [[nodiscard]] constexpr auto takeRate(C const& take_rate) noexcept(noexcept_release<s_cts>() && !Resizeable<C>)
       -> std::conditional_t<Resizeable<C>, std::vector<Value>, std::array<Value, C{}.size()>>
     {
       auto [take, _] = takeCarryRates(take_rate, std::array<double, 0> {});     
@@ -435,7 +1008,7 @@ namespace blofeld
     }
   
     // Take a single rate only:
-    [[nodiscard]] constexpr auto takeRate(double const take_rate) noexcept(!s_cts.debug)
+    [[nodiscard]] constexpr auto takeRate(double const take_rate) noexcept(noexcept_release<s_cts>())
       -> Value
     {
       auto [take, _] = takeCarryRates(std::array<double, 1> { take_rate }, std::array<double, 0> {});
@@ -443,7 +1016,7 @@ namespace blofeld
     }
     
     // Carry (always a single) rate only:
-    [[nodiscard]] constexpr auto carryRate(double const carry_rate) noexcept(!s_cts.debug)
+    [[nodiscard]] constexpr auto carryRate(double const carry_rate) noexcept(noexcept_release<s_cts>())
       -> Value
     {
       auto [_, carry] = takeCarryRates(std::array<double, 0> {}, std::array<double, 1> { carry_rate });
@@ -461,6 +1034,34 @@ namespace blofeld
       return takeCarryProps(take_props, carry_props);
     }
 
+
+    // Allocation-free takeCarryRates for a run-time number of take rates (e.g. with Vector containers):
+    // the proportions are made (or re-used) in place and applied in the same call, and the total taken
+    // for each rate is written to take, which must be the same length as take_rate
+    template <std::size_t s_nc>
+    constexpr auto takeCarryRates(
+      std::span<double const> const take_rate,
+      std::array<double, s_nc> const carry_rate,  // Either size-0 or size-1 (and therefore pass by value)
+      std::span<Value> const take
+    )
+      -> std::array<Value, (s_cinfo.carry_type!=CarryType::None && s_nc!=0U) ? 1U : 0U>
+    {
+      static_assert(s_nc <= 1U, "Invalid arguments to takeCarryRates: invalid std::array<double, 2+> passed as carry_rate");
+      constexpr bool s_carry = s_cinfo.carry_type!=CarryType::None && s_nc!=0U;
+      if (ssize(take) != ssize(take_rate)) {
+        m_bridge.stop("Invalid arguments to takeCarryRates:  take (length {}) and take_rate (length {}) differ", ssize(take), ssize(take_rate));
+      }
+      
+      std::fill(take.begin(), take.end(), zero());
+      auto const props = preparedProps(take_rate, carry_rate);
+      std::array<Value, s_carry ? 1U : 0U> carry {};
+      if constexpr (s_carry) {
+        carry.front() = applyProps<true>(props.take, props.carry, take);
+      } else {
+        static_cast<void>(applyProps<false>(props.take, 0.0, take));
+      }
+      return carry;
+    }
     
     /* Underlying functions that do the work (even when we have only a single proportion) */
 
@@ -480,27 +1081,6 @@ namespace blofeld
       // Note: if CarryType::None then simply ignore any provided carry_rate and convert to 0
       // \Pre-conditions
       
-      // Adjust competing rates (accumulate works with size-0 arrays):
-      double const carry_adj = [&](){
-        if constexpr (!s_carry || s_cinfo.carry_type == CarryType::None) {
-          return 0.0;
-        } else if constexpr (s_cinfo.carry_type == CarryType::Sequential) {
-          return carry_rate.front() * static_cast<double>(ssize(m_working));
-        } else if constexpr (s_cinfo.carry_type == CarryType::Immediate) {
-          static_assert(false, "Logic error in makeProps: CarryType::Immediate is not yet implemented");
-          return carry_rate.front();
-        } else {
-          static_assert(false, "Logic error in makeProps: unhandled CarryType");
-        }
-      }();
-      double const sumrates = std::accumulate(take_rate.begin(), take_rate.end(), carry_adj);
-      double const adj = sumrates==0.0 ? 0.0 : ((1.0 - std::exp(-sumrates)) / sumrates);
-      
-      // Re-usable lambda:
-      auto rateToProp = [adj](double const rate) {
-        return 1.0 - std::exp(-rate * adj);
-      };
-          
       // Return values:
       auto rv = [&](){
         if constexpr (Fixedsize<C> && C{}.size()==0U) {
@@ -545,17 +1125,15 @@ namespace blofeld
         } 
       }();
       
-      // Update the values:
+      // The proportions are made (or re-used) in the cache, then copied out:
+      auto const props = preparedProps(take_rate, carry_rate);
       if constexpr (Resizeable<C> || decltype(take_rate){}.size() > 0U) {
-        if constexpr (s_cts.debug) {
-          if (!identical(ssize(take_rate), ssize(rv.take_prop))) m_bridge.stop("Logic error in makeProps: unequal length take_rate and take_prop");
-        }
         for (index i=0; i<ssize(take_rate); ++i)
         {
-          rv.take_prop[i] = rateToProp(take_rate[i]);
+          rv.take_prop[i] = props.take[i];
         }
       }
-      if constexpr (s_carry) rv.carry_prop.front() = rateToProp(carry_adj);
+      if constexpr (s_carry) rv.carry_prop.front() = props.carry;
 
       return rv;  
     }
@@ -575,32 +1153,6 @@ namespace blofeld
       constexpr bool s_carry = s_cinfo.carry_type!=CarryType::None && s_nc!=0U;
       // Note: if CarryType::None then simply ignore any provided carry_prop
       
-      if constexpr (s_cts.debug) {
-        double sumprop = std::accumulate(take_prop.begin(), take_prop.end(), 0.0);
-        if constexpr (s_carry) sumprop += carry_prop[0];
-        if (sumprop > 1.0) m_bridge.stop("Invalid arguments to takeCarryProps:  sum of props exceeds 1");
-      }
-      validate();
-      // \Pre-conditions
-      
-      // Flag that an update is in progress:
-      if constexpr (s_cts.debug) {
-        m_checking.value.take_applied = false;
-        
-        // Check carry rates are applied exactly once:
-        if constexpr (s_carry) {
-          if (!m_checking.value.carry_applied) m_bridge.stop("Runtime error: attempt to call carryProp more than once without applyChanges");
-          m_checking.value.carry_applied = false;
-          /* TODO: uncomment below and update applyChanges to match
-          if constexpr (Fixedsize<C> && !C{}.empty()) {
-            m_checking.value.carry_applied = false;
-          } else if constexpr (Resizeable<C>) {
-            if (!m_working.empty()) m_checking.value.carry_applied = false;
-          }
-          */
-        }
-      }
-      
       // Set up different return structs depending on what we are going to need:
       auto rv = [&](){
         if constexpr (Fixedsize<C> && C{}.size()==0U) {
@@ -650,145 +1202,10 @@ namespace blofeld
         if (rv.take.size() != take_prop.size()) m_bridge.stop("Logic error in takeCarryProps:  rv and take_prop unequal size");
       }
       
-      // Short circuit in case we are inactive:
-      if constexpr (s_carry && Fixedsize<decltype(m_working)> && decltype(m_working){}.empty()) {
-        rv.carry.front() = getCarryThrough();
-        return rv;
-      } else if constexpr (s_carry && Resizeable<decltype(m_working)>) {
-        if (m_working.empty()) {
-          rv.carry.front() = getCarryThrough();
-          return rv;
-        } else {
-          // Sanity check:
-          if constexpr (s_cts.debug) if (!identical(getCarryThrough(), zero())) m_bridge.stop("Logic error: non-zero carry-through for active compartment");
-        }
-      } else {
-        // Sanity check:
-        if constexpr (s_carry && s_cts.debug) if (!identical(getCarryThrough(), zero())) m_bridge.stop("Logic error: non-zero carry-through for active compartment");
-      }
-      
-      // If we have a carry prop then we need to track that:
-      auto carry = [](){
-        if constexpr (s_carry) {
-          struct { double value = zero(); } tt;
-          return tt;
-        } else {
-          struct { } tt;
-          return tt;
-        }
-      }();
-      
-      // Outer loop is the sub-compartment, as we need to do everything (take and carry) together:
-      for (auto& cc : m_working)
-      {
-        // For Deterministic we just need the total removed, for Stochastic we also need the adjusted probability:
-        auto removed = [](){
-          if constexpr (s_mtype==ModelType::Deterministic) {
-            struct {
-              Value value = zero();
-            } tt;
-            return tt;
-          } else if constexpr (s_mtype==ModelType::Stochastic) {
-            struct {
-              Value value = zero();
-              double prop = 1.0;
-            } tt;
-            return tt;
-          } else {
-            static_assert(false, "Unhandled ModelType in takeCarryProps");
-          }
-        }();
-        
-        // First deal with the take proportion(s) - this could be a size-0 C:
-        for (index i=0; i<ssize(take_prop); ++i)
-        {
-          // Calculate the removal:
-          Value tt = [&](){
-            if constexpr (s_mtype==ModelType::Deterministic) {
-              // For deterministic it is just a fixed proportion:
-              return cc*take_prop[i];
-              
-            } else if constexpr (s_mtype==ModelType::Stochastic) {
-              // For stochastic we also need to adjust the probability:
-              int const val = m_bridge.rbinom(cc - removed.value, take_prop[i] / removed.prop);
-              removed.prop -= take_prop[i];
-              return val;
-              
-            } else {
-              static_assert(false, "Logic error in takeCarryProps: unhandled ModelType");
-            }
-          }();          
-          
-          // Error and bounds checking:
-          if constexpr (s_cts.debug) {
-            if (tt < zero()) m_bridge.stop("Logic error in takeCarryProps:  tt < 0");
-            if (i >= ssize(rv.take)) m_bridge.stop("Bounds check error in takeCarryProps:  rv.take too small");
-          }          
-          
-          // Changes:
-          removed.value += tt;
-          rv.take[i] += tt;
-        }
-
-        // Then deal with the carry proportion, if there is one:
-        if constexpr (s_carry) {
-        
-          // For CarryType::Immediate we need to apply any carry-forward beforehand:
-          if constexpr (s_cinfo.carry_type == CarryType::Immediate) {
-            static_assert(false, "NEEDS TESTING");
-            cc += carry.value;
-          }
-        
-          // Calculate the carry:
-          Value tt = [&](){
-            if constexpr (s_mtype==ModelType::Deterministic) {
-              // For deterministic it is just a fixed proportion:
-              return cc*carry_prop[0];
-              
-            } else if constexpr (s_mtype==ModelType::Stochastic) {
-              // Sanity check:
-              if constexpr (s_cts.debug) {
-                if (!identical(1.0-removed.prop, std::accumulate(take_prop.begin(), take_prop.end(), 0.0), s_cts.tol)) m_bridge.stop("Logic error in takeCarryProps:  1-removed.prop ({}) != sum(take_prop) ({})", 1.0-removed.prop, std::accumulate(take_prop.begin(), take_prop.end(), 0.0));
-              }
-              // For stochastic we also need to use the adjusted probability:
-              return m_bridge.rbinom(cc - removed.value, carry_prop[0] / removed.prop);
-              
-            } else {
-              static_assert(false, "Logic error in takeCarryProps: unhandled ModelType");
-            }
-          }();          
-        
-          // For CarryType::Sequential we need to apply any carry-forward afterward:
-          if constexpr (s_cinfo.carry_type == CarryType::Sequential) {
-            cc += carry.value;
-          }
-          
-          // Carry forward to next subcompartment:
-          cc -= tt;
-          carry.value = tt;
-          
-          static_assert(
-            s_cinfo.carry_type == CarryType::Sequential || s_cinfo.carry_type == CarryType::Immediate, 
-            "Logic error in takeCarryProps:  unhandled CarryType"        
-          );
-        
-        } else {
-          static_assert(s_nc==0U, "Logic error in takeCarryProps:  s_nc not in {1,0}");
-        }
-        
-        // Then finally apply changes to m_working:
-        cc -= removed.value;        
-      }
-      
-      // Then add the final carry value:
       if constexpr (s_carry) {
-        rv.carry.front() = carry.value;
-      }
-      
-      // Sanity check:
-      if constexpr (s_cts.debug) {
-        m_checking.value.changes -= std::accumulate(rv.carry.begin(), rv.carry.end(), std::accumulate(rv.take.begin(), rv.take.end(), zero()));
-        validate();
+        rv.carry.front() = applyProps<true>(take_prop, carry_prop.front(), rv.take);
+      } else {
+        static_cast<void>(applyProps<false>(take_prop, 0.0, rv.take));
       }
       
       return rv;
@@ -796,45 +1213,49 @@ namespace blofeld
     
     
     /* Forwarding methods */
+    // Note: between changes (insert, takeCarryProps etc) and applyChanges these include the pending changes
     
+    // Note: the values may be changed through these, so the occupancy mask is re-built when next needed
     constexpr auto begin() noexcept
     {
-      return m_current.begin();
+      invalidateOccupancy();
+      return m_values.begin();
     }
     constexpr auto end() noexcept
     {
-      return m_current.end();
+      invalidateOccupancy();
+      return m_values.end();
     }
 
     constexpr auto begin() const noexcept
     {
-      return m_current.begin();
+      return m_values.begin();
     }
     constexpr auto end() const noexcept
     {
-      return m_current.end();
+      return m_values.end();
     }
 
     constexpr auto cbegin() const noexcept
     {
-      return m_current.cbegin();
+      return m_values.cbegin();
     }
     constexpr auto cend() const noexcept
     {
-      return m_current.end();
+      return m_values.end();
     }
 
     [[nodiscard]] constexpr auto size() const noexcept
       -> std::size_t
     {
-      return static_cast<std::size_t>(m_current.size());
+      return static_cast<std::size_t>(m_values.size());
     }
     
     // Note: is constexpr for Array etc but not Vector/InplaceVector
     [[nodiscard]] constexpr auto empty() const noexcept
       -> bool
     {
-      return m_current.empty();
+      return m_values.empty();
     }    
     
     
@@ -853,19 +1274,36 @@ namespace blofeld
       } else {
         insert(total);
       }
-      m_current = m_working;
+      m_total = m_working_total;
+      m_pending = false;
+      if constexpr (s_cts.debug) {
+        m_checking.value.changes = zero();
+      }
       validate();
     }
     
     template <std::size_t s_ntake>
     auto process_rate(double const carry_rate, std::array<double, s_ntake> const& take_rate)
     {
-      auto [take, carry] = takeCarryRates(take_rate, std::array { carry_rate });
       struct
       {
         Value carry;
         std::array<Value, s_ntake> take;
-      } rv { carry.front(), take };
+      } rv {};
+      
+      if constexpr (s_cinfo.carry_type == CarryType::None && s_cinfo.container_type != ContainerType::Disabled) {
+        // A single sub-compartment ignores carry, so the legacy carry becomes an extra (last) take:
+        std::array<double, s_ntake+1> rates {};
+        std::copy(take_rate.begin(), take_rate.end(), rates.begin());
+        rates.back() = carry_rate;
+        auto [take, _] = takeCarryRates(rates, std::array<double, 0> {});
+        std::copy(take.begin(), take.end()-1, rv.take.begin());
+        rv.carry = take.back();
+      } else {
+        auto [take, carry] = takeCarryRates(take_rate, std::array { carry_rate });
+        rv.take = take;
+        if constexpr (std::tuple_size_v<std::remove_cvref_t<decltype(carry)>> > 0U) rv.carry = carry.front();
+      }
       return rv;
     }
     
@@ -881,7 +1319,7 @@ namespace blofeld
     
     constexpr bool is_active()
     {
-      if constexpr (Fixedsize<decltype(m_working)> && decltype(m_working){}.size()==0U) {
+      if constexpr (Fixedsize<decltype(m_values)> && decltype(m_values){}.size()==0U) {
         return false;
       } else {
         return true;
@@ -893,7 +1331,7 @@ namespace blofeld
     
 
     auto apply_changes()
-      noexcept(!s_cts.debug)
+      noexcept(noexcept_release<s_cts>())
       -> void
     {
       / *
@@ -1035,14 +1473,14 @@ namespace blofeld
     */
 
     // Note: unusual + overloads return Value
-    [[nodiscard]] constexpr auto operator+(Value const sum) const noexcept(!s_cts.debug)
+    [[nodiscard]] constexpr auto operator+(Value const sum) const noexcept(noexcept_release<s_cts>())
         -> Value
     {
       return sum + getTotal();
     }
 
     template <auto s_s, ModelType s_m, CompartmentInfo s_c, typename T>
-    [[nodiscard]] constexpr auto operator+(Compartment<s_s, s_m, s_c> const& obj) const noexcept(!s_cts.debug)
+    [[nodiscard]] constexpr auto operator+(Compartment<s_s, s_m, s_c> const& obj) const noexcept(noexcept_release<s_cts>())
         -> Value
     {
       return obj.getTotal() + getTotal();
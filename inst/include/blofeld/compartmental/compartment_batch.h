@@ -0,0 +1,624 @@
+#ifndef BLOFELD_COMPARTMENT_BATCH_H
+#define BLOFELD_COMPARTMENT_BATCH_H
+
+#include <array>
+#include <vector>
+#include <span>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "./compartment_types.h"
+#include "../utilities/tools.h"
+
+namespace blofeld
+{
+
+  /*
+  CompartmentBatch holds the sub-compartment values of one compartment type
+  for many groups in a single structure-of-arrays block:  each sub-compartment
+  is a contiguous lane of (padded) group values, so that the take/carry
+  updates can be done for all groups in a single pass with the group as the
+  inner (vectorisable) loop.  Semantics match Compartment exactly, including
+  all takes and carries seeing the pre-step values (each sub-compartment is
+  read before it is changed in place).
+  */
+
+  template <auto s_cts, ModelType s_mtype, CompartmentInfo s_cinfo>
+  class CompartmentBatch
+  {
+  private:
+    using Value = std::conditional_t<
+      s_mtype == ModelType::Deterministic,
+      double,
+      std::conditional_t<
+        s_mtype == ModelType::Stochastic,
+        int,
+        void
+      >
+    >;
+    static_assert(!std::is_same<Value, void>::value, "Unrecognised ModelType");
+    static_assert(s_cinfo.carry_type != CarryType::Immediate, "CarryType::Immediate is not yet implemented for CompartmentBatch");
+
+    // Lanes are padded to a multiple of 64 bytes:
+    static constexpr int s_lane_width = 64 / static_cast<int>(sizeof(Value));
+
+    using Bridge = decltype(s_cts)::Bridge;
+    Bridge& m_bridge;
+
+    int m_ngroups = 0;
+    int m_n = 0;
+    int m_stride = 0;
+
+    // Layout is [sub-compartment][group], with m_stride between lanes (updated in place, as for Compartment):
+    std::vector<Value> m_values;
+
+    // Whether there are changes that have not yet been applied:
+    bool m_pending = false;
+
+    // Used when n == 0 (one value per group):
+    std::vector<Value> m_carry_through;
+
+    // Used for debug only (totals as of the last applyChanges, and changes since):
+    std::vector<Value> m_totals;
+    std::vector<Value> m_changes;
+
+    // Scratch for the batched binomial draws (stochastic only):
+    std::vector<int> m_draw_n;
+    std::vector<double> m_draw_p;
+    std::vector<int> m_draw;
+    std::vector<int> m_removed;
+    std::vector<double> m_prop;
+
+    // Scratch for one draw per sub-compartment in distribute (stochastic only, as Compartment::drawBuffer):
+    std::vector<int> m_inits;
+
+    CompartmentBatch() = delete;
+
+    [[nodiscard]] constexpr auto lane(std::vector<Value>& values, int const sub) noexcept
+      -> Value*
+    {
+      return values.data() + static_cast<std::size_t>(sub) * static_cast<std::size_t>(m_stride);
+    }
+
+    [[nodiscard]] constexpr auto lane(std::vector<Value> const& values, int const sub) const noexcept
+      -> Value const*
+    {
+      return values.data() + static_cast<std::size_t>(sub) * static_cast<std::size_t>(m_stride);
+    }
+
+    constexpr auto checkGroup([[maybe_unused]] index const group) const
+      -> void
+    {
+      if constexpr (s_cts.debug) {
+        if (group < 0 || group >= m_ngroups) m_bridge.stop("Group index {} out of range in CompartmentBatch", group);
+      }
+    }
+
+    template <std::size_t s_nspan>
+    constexpr auto checkSpans([[maybe_unused]] std::array<std::span<double const>, s_nspan> const& spans, [[maybe_unused]] index const nrep = 1) const
+      -> void
+    {
+      if constexpr (s_cts.debug) {
+        if (nrep < 1 || m_ngroups % nrep != 0) m_bridge.stop("Invalid number of replicates {} for {} groups in CompartmentBatch", nrep, m_ngroups);
+        for (auto const& ss : spans)
+        {
+          if (ssize(ss) != m_ngroups / nrep) m_bridge.stop("Invalid argument to CompartmentBatch:  span of length {} does not match {} groups", ssize(ss), m_ngroups / nrep);
+        }
+      }
+    }
+
+    constexpr auto validate()
+      -> void
+    {
+      if constexpr (s_cts.debug) {
+        for (index g=0; g<m_ngroups; ++g)
+        {
+          Value working = zero();
+          for (int k=0; k<m_n; ++k)
+          {
+            if (lane(m_values, k)[g] < zero()) m_bridge.stop("Logic error: negative compartment value in group {}", g);
+            working += lane(m_values, k)[g];
+          }
+          // Note: an absolute as well as relative tolerance, as values may decay towards zero
+          Value const expected = m_totals[g] + m_changes[g];
+          bool const match = [&](){
+            if constexpr (std::is_integral_v<Value>) {
+              return working == expected;
+            } else {
+              return std::abs(working - expected) <= s_cts.tol * std::max(1.0, std::abs(expected));
+            }
+          }();
+          if (!match) {
+            m_bridge.stop("Unequal sum(working)={} and total={} + changes={} in group {}", working, m_totals[g], m_changes[g], g);
+          }
+        }
+      }
+    }
+
+    // Rates to proportions for nprop groups (or blocks of replicates):
+    template <std::size_t s_ntake, std::size_t s_nc>
+    auto makePropsImpl(
+      index const nprop,
+      std::array<std::span<double const>, s_ntake> const& take_rate,
+      std::array<std::span<double const>, s_nc> const& carry_rate,
+      std::array<std::span<double>, s_ntake> const& take_prop,
+      std::array<std::span<double>, s_nc> const& carry_prop
+    ) const noexcept
+      -> void
+    {
+      static_assert(s_nc <= 1U, "Invalid arguments to makeProps: more than one carry rate");
+      constexpr bool s_carry = s_cinfo.carry_type!=CarryType::None && s_nc!=0U;
+
+      for (index g=0; g<nprop; ++g)
+      {
+        double carry_adj = 0.0;
+        if constexpr (s_carry) carry_adj = carry_rate[0][g] * static_cast<double>(m_n);
+        double sumrates = carry_adj;
+        for (std::size_t t=0; t<s_ntake; ++t) sumrates += take_rate[t][g];
+        double const adj = sumrates==0.0 ? 0.0 : ((1.0 - std::exp(-sumrates)) / sumrates);
+
+        for (std::size_t t=0; t<s_ntake; ++t) take_prop[t][g] = 1.0 - std::exp(-take_rate[t][g] * adj);
+        if constexpr (s_carry) {
+          carry_prop[0][g] = 1.0 - std::exp(-carry_adj * adj);
+        } else if constexpr (s_nc == 1U) {
+          carry_prop[0][g] = 0.0;
+        }
+      }
+    }
+
+    // Take/carry for all groups, where group g uses proportion g/nrep if s_shared (and g otherwise):
+    template <bool s_shared, std::size_t s_ntake, std::size_t s_nc>
+    auto takeCarryImpl(
+      [[maybe_unused]] index const nrep,
+      std::array<std::span<double const>, s_ntake> const& take_prop,
+      std::array<std::span<double const>, s_nc> const& carry_prop,
+      std::array<std::span<Value>, s_ntake> const& take,
+      std::array<std::span<Value>, s_nc> const& carry
+    ) noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      static_assert(s_nc <= 1U, "Invalid arguments to takeCarryProps: more than one carry prop");
+      constexpr bool s_carry = s_cinfo.carry_type!=CarryType::None && s_nc!=0U;
+      auto const pidx = [nrep](index const g) noexcept -> index {
+        if constexpr (s_shared) {
+          return g / nrep;
+        } else {
+          return g;
+        }
+      };
+
+      if constexpr (s_cts.debug) {
+        for (index g=0; g<m_ngroups/nrep; ++g)
+        {
+          double sumprop = 0.0;
+          for (std::size_t t=0; t<s_ntake; ++t) sumprop += take_prop[t][g];
+          if constexpr (s_carry) sumprop += carry_prop[0][g];
+          if (sumprop > 1.0) m_bridge.stop("Invalid arguments to takeCarryProps:  sum of props exceeds 1 for group {}", g);
+        }
+      }
+
+      for (std::size_t t=0; t<s_ntake; ++t) std::fill(take[t].begin(), take[t].end(), zero());
+      if constexpr (s_nc == 1U) std::fill(carry[0].begin(), carry[0].end(), zero());
+
+      // Short circuit in case we are inactive:
+      if (m_n == 0) {
+        if constexpr (s_carry) {
+          std::copy(m_carry_through.begin(), m_carry_through.end(), carry[0].begin());
+          std::fill(m_carry_through.begin(), m_carry_through.end(), zero());
+        }
+        return;
+      }
+
+      // Carry out of the previous sub-compartment (initially zero) is held in carry[0]:
+      m_pending = true;
+      for (int k=0; k<m_n; ++k)
+      {
+        Value* const wk = lane(m_values, k);
+
+        if constexpr (s_mtype==ModelType::Deterministic) {
+
+          // Every step of this loop is independent between groups, so it vectorises:
+          for (index g=0; g<m_ngroups; ++g)
+          {
+            double const cc = wk[g];
+            double removed = 0.0;
+            for (std::size_t t=0; t<s_ntake; ++t)
+            {
+              double const tt = cc * take_prop[t][pidx(g)];
+              take[t][g] += tt;
+              removed += tt;
+            }
+            if constexpr (s_carry) {
+              double const tt = cc * carry_prop[0][pidx(g)];
+              wk[g] = cc - removed - tt + carry[0][g];
+              carry[0][g] = tt;
+            } else {
+              wk[g] = cc - removed;
+            }
+          }
+
+        } else if constexpr (s_mtype==ModelType::Stochastic) {
+
+          // Each take (and then the carry) is drawn for all groups in one batch, with the
+          // probability conditional on the earlier takes for that group:
+          m_removed.assign(m_ngroups, 0);
+          m_prop.assign(m_ngroups, 1.0);
+          m_draw_n.resize(m_ngroups);
+          m_draw_p.resize(m_ngroups);
+          m_draw.resize(m_ngroups);
+
+          for (std::size_t t=0; t<s_ntake; ++t)
+          {
+            for (index g=0; g<m_ngroups; ++g)
+            {
+              m_draw_n[g] = wk[g] - m_removed[g];
+              m_draw_p[g] = take_prop[t][pidx(g)] / m_prop[g];
+            }
+            m_bridge.rbinom_batch(m_draw_n, m_draw_p, m_draw);
+            for (index g=0; g<m_ngroups; ++g)
+            {
+              m_prop[g] -= take_prop[t][pidx(g)];
+              take[t][g] += m_draw[g];
+              m_removed[g] += m_draw[g];
+            }
+          }
+          if constexpr (s_carry) {
+            for (index g=0; g<m_ngroups; ++g)
+            {
+              m_draw_n[g] = wk[g] - m_removed[g];
+              m_draw_p[g] = carry_prop[0][pidx(g)] / m_prop[g];
+            }
+            m_bridge.rbinom_batch(m_draw_n, m_draw_p, m_draw);
+            for (index g=0; g<m_ngroups; ++g)
+            {
+              wk[g] = wk[g] - m_removed[g] - m_draw[g] + carry[0][g];
+              carry[0][g] = m_draw[g];
+            }
+          } else {
+            for (index g=0; g<m_ngroups; ++g)
+            {
+              wk[g] -= m_removed[g];
+            }
+          }
+
+        } else {
+          static_assert(false, "Unhandled ModelType in takeCarryProps");
+        }
+      }
+
+      // Sanity check:
+      if constexpr (s_cts.debug) {
+        for (index g=0; g<m_ngroups; ++g)
+        {
+          for (std::size_t t=0; t<s_ntake; ++t) m_changes[g] -= take[t][g];
+          if constexpr (s_carry) m_changes[g] -= carry[0][g];
+        }
+        validate();
+      }
+    }
+
+  public:
+
+    /* Constructors */
+
+    explicit CompartmentBatch(Bridge& bridge, int const ngroups)
+      : CompartmentBatch(bridge, ngroups, s_cinfo.n)
+    {
+    }
+
+    // For Vector containers the number of sub-compartments is set at run time (but is shared by all groups):
+    explicit CompartmentBatch(Bridge& bridge, int const ngroups, int const n)
+      : m_bridge(bridge)
+    {
+      if (ngroups < 0) m_bridge.stop("Invalid ngroups < 0 for CompartmentBatch");
+      if (n < 0) m_bridge.stop("Invalid n < 0 for CompartmentBatch");
+      if (s_cinfo.container_type != ContainerType::Vector && n != s_cinfo.n) {
+        m_bridge.stop("The number of sub-compartments can only be changed for ContainerType::Vector");
+      }
+
+      m_ngroups = ngroups;
+      m_n = n;
+      m_stride = ((ngroups + s_lane_width - 1) / s_lane_width) * s_lane_width;
+
+      m_values.assign(static_cast<std::size_t>(m_n) * static_cast<std::size_t>(m_stride), zero());
+      m_carry_through.assign(static_cast<std::size_t>(m_ngroups), zero());
+      if constexpr (s_cts.debug) {
+        m_totals.assign(static_cast<std::size_t>(m_ngroups), zero());
+        m_changes.assign(static_cast<std::size_t>(m_ngroups), zero());
+      }
+
+      validate();
+    }
+
+
+    /* Utility function to get a correctly-typed zero */
+    [[nodiscard]] static constexpr auto zero() noexcept
+    {
+      return static_cast<Value>(0);
+    }
+
+
+    /* Methods to change contents */
+
+    // Reset all groups to 0:
+    auto reset() noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      std::fill(m_values.begin(), m_values.end(), zero());
+      std::fill(m_carry_through.begin(), m_carry_through.end(), zero());
+      m_pending = false;
+      if constexpr (s_cts.debug) {
+        std::fill(m_totals.begin(), m_totals.end(), zero());
+        std::fill(m_changes.begin(), m_changes.end(), zero());
+      }
+      validate();
+    }
+
+    // Add a total to the first subcompartment of a single group:
+    auto insert(index const group, Value const total) noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      checkGroup(group);
+      if (total < zero()) m_bridge.stop("Invalid total < 0");
+
+      if (m_n == 0) {
+        m_carry_through[group] = total;
+        return;
+      }
+      lane(m_values, 0)[group] += total;
+      m_pending = true;
+
+      if constexpr (s_cts.debug) {
+        m_changes[group] += total;
+      }
+    }
+
+    // Add a total to the first subcompartment of every group (e.g. the carry from an upstream batch):
+    auto insert(std::span<Value const> const totals) noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      if constexpr (s_cts.debug) {
+        if (ssize(totals) != m_ngroups) m_bridge.stop("Invalid argument to insert:  span of length {} does not match {} groups", ssize(totals), m_ngroups);
+        for (auto const val : totals)
+        {
+          if (val < zero()) m_bridge.stop("Invalid total < 0");
+        }
+      }
+
+      if (m_n == 0) {
+        std::copy(totals.begin(), totals.end(), m_carry_through.begin());
+        return;
+      }
+
+      Value* const wk = lane(m_values, 0);
+      for (index g=0; g<m_ngroups; ++g)
+      {
+        wk[g] += totals[g];
+      }
+      m_pending = true;
+
+      if constexpr (s_cts.debug) {
+        for (index g=0; g<m_ngroups; ++g) m_changes[g] += totals[g];
+      }
+    }
+
+    // Add or remove a fixed number evenly/randomly throughout a single group:
+    auto distribute(index const group, Value const total) noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      checkGroup(group);
+      if (m_n == 0) m_bridge.stop("Unable to distribute values within a disabled compartment");
+      if (total < -getTotal(group)) m_bridge.stop("Invalid total < -available");
+
+      if constexpr (s_mtype==ModelType::Deterministic) {
+        for (int k=0; k<m_n; ++k)
+        {
+          lane(m_values, k)[group] += total / static_cast<double>(m_n);
+        }
+      } else if constexpr (s_mtype==ModelType::Stochastic) {
+        if (total < zero()) m_bridge.stop("Unable to remove values using distribute for a stochastic compartment");
+        m_inits.resize(static_cast<std::size_t>(m_n));
+        m_bridge.rmultinomEqual(total, std::span<int>(m_inits));
+        for (int k=0; k<m_n; ++k)
+        {
+          lane(m_values, k)[group] += m_inits[k];
+        }
+      } else {
+        static_assert(false, "Unrecognised ModelType in distribute");
+      }
+      m_pending = true;
+
+      if constexpr (s_cts.debug) {
+        m_changes[group] += total;
+      }
+    }
+
+    // Apply changes from taking proportions and inserting/distributing etc:
+    auto applyChanges() noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      validate();
+      m_pending = false;
+      if constexpr (s_cts.debug) {
+        m_totals = getTotals();
+        std::fill(m_changes.begin(), m_changes.end(), zero());
+      }
+    }
+
+
+    /* Accessors */
+
+    [[nodiscard]] auto ngroups() const noexcept
+      -> int
+    {
+      return m_ngroups;
+    }
+
+    [[nodiscard]] auto size() const noexcept
+      -> std::size_t
+    {
+      return static_cast<std::size_t>(m_n);
+    }
+
+    [[nodiscard]] auto getValues(index const group) const
+      -> std::vector<Value>
+    {
+      checkGroup(group);
+      std::vector<Value> rv(static_cast<std::size_t>(m_n));
+      for (int k=0; k<m_n; ++k)
+      {
+        rv[k] = lane(m_values, k)[group];
+      }
+      return rv;
+    }
+
+    auto setValues(index const group, std::span<Value const> const values)
+      -> void
+    {
+      checkGroup(group);
+      if (ssize(values) != m_n) m_bridge.stop("Size mis-match in provided values");
+      if (m_pending) m_bridge.stop("It is not possible to set values between applying rates and calling applyChanges()");
+      for (int k=0; k<m_n; ++k)
+      {
+        if (values[k] < zero()) m_bridge.stop("Invalid value < 0");
+      }
+      for (int k=0; k<m_n; ++k)
+      {
+        lane(m_values, k)[group] = values[k];
+      }
+      if constexpr (s_cts.debug) {
+        m_totals[group] = getTotal(group);
+      }
+    }
+
+    // Note: totals (and values) include any changes not yet applied
+    [[nodiscard]] auto getTotal(index const group) const
+      -> Value
+    {
+      checkGroup(group);
+      Value total = zero();
+      for (int k=0; k<m_n; ++k)
+      {
+        total += lane(m_values, k)[group];
+      }
+      return total;
+    }
+
+    // Totals for all groups, summed lane-by-lane so the inner loop is contiguous:
+    [[nodiscard]] auto getTotals() const
+      -> std::vector<Value>
+    {
+      std::vector<Value> rv(static_cast<std::size_t>(m_ngroups), zero());
+      for (int k=0; k<m_n; ++k)
+      {
+        Value const* const cur = lane(m_values, k);
+        for (index g=0; g<m_ngroups; ++g)
+        {
+          rv[g] += cur[g];
+        }
+      }
+      return rv;
+    }
+
+
+    /* Batched equivalents of Compartment::makeProps and Compartment::takeCarryProps */
+
+    // Convert per-group rates to per-group proportions (all spans have length ngroups):
+    template <std::size_t s_ntake, std::size_t s_nc>
+    auto makeProps(
+      std::array<std::span<double const>, s_ntake> const& take_rate,
+      std::array<std::span<double const>, s_nc> const& carry_rate,
+      std::array<std::span<double>, s_ntake> const& take_prop,
+      std::array<std::span<double>, s_nc> const& carry_prop
+    ) const noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      checkSpans(take_rate);
+      checkSpans(carry_rate);
+      makePropsImpl(m_ngroups, take_rate, carry_rate, take_prop, carry_prop);
+    }
+
+    // As makeProps, but for groups held as blocks of nrep consecutive replicates with the same rates
+    // (so all spans have length ngroups/nrep, and each proportion is only calculated once):
+    template <std::size_t s_ntake, std::size_t s_nc>
+    auto makePropsShared(
+      index const nrep,
+      std::array<std::span<double const>, s_ntake> const& take_rate,
+      std::array<std::span<double const>, s_nc> const& carry_rate,
+      std::array<std::span<double>, s_ntake> const& take_prop,
+      std::array<std::span<double>, s_nc> const& carry_prop
+    ) const noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      checkSpans(take_rate, nrep);
+      checkSpans(carry_rate, nrep);
+      makePropsImpl(m_ngroups / nrep, take_rate, carry_rate, take_prop, carry_prop);
+    }
+
+    // Apply per-group proportions to all groups and write the per-group totals taken/carried:
+    template <std::size_t s_ntake, std::size_t s_nc>
+    auto takeCarryProps(
+      std::array<std::span<double const>, s_ntake> const& take_prop,
+      std::array<std::span<double const>, s_nc> const& carry_prop,
+      std::array<std::span<Value>, s_ntake> const& take,
+      std::array<std::span<Value>, s_nc> const& carry
+    ) noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      checkSpans(take_prop);
+      checkSpans(carry_prop);
+      takeCarryImpl<false>(1, take_prop, carry_prop, take, carry);
+    }
+
+    // As takeCarryProps, but with the proportions (length ngroups/nrep) shared by each block of nrep
+    // consecutive replicates (take and carry still have length ngroups):
+    template <std::size_t s_ntake, std::size_t s_nc>
+    auto takeCarryPropsShared(
+      index const nrep,
+      std::array<std::span<double const>, s_ntake> const& take_prop,
+      std::array<std::span<double const>, s_nc> const& carry_prop,
+      std::array<std::span<Value>, s_ntake> const& take,
+      std::array<std::span<Value>, s_nc> const& carry
+    ) noexcept(noexcept_release<s_cts>())
+      -> void
+    {
+      checkSpans(take_prop, nrep);
+      checkSpans(carry_prop, nrep);
+      takeCarryImpl<true>(nrep, take_prop, carry_prop, take, carry);
+    }
+
+    // Convenience overload returning the per-group totals taken/carried:
+    template <std::size_t s_ntake, std::size_t s_nc>
+    [[nodiscard]] auto takeCarryProps(
+      std::array<std::span<double const>, s_ntake> const& take_prop,
+      std::array<std::span<double const>, s_nc> const& carry_prop
+    ) noexcept(noexcept_release<s_cts>())
+    {
+      struct
+      {
+        std::array<std::vector<Value>, s_ntake> take;
+        std::array<std::vector<Value>, s_nc> carry;
+      } rv;
+
+      std::array<std::span<Value>, s_ntake> take_out;
+      for (std::size_t t=0; t<s_ntake; ++t) {
+        rv.take[t].resize(static_cast<std::size_t>(m_ngroups));
+        take_out[t] = rv.take[t];
+      }
+      std::array<std::span<Value>, s_nc> carry_out;
+      for (std::size_t t=0; t<s_nc; ++t) {
+        rv.carry[t].resize(static_cast<std::size_t>(m_ngroups));
+        carry_out[t] = rv.carry[t];
+      }
+
+      takeCarryProps(take_prop, carry_prop, take_out, carry_out);
+      return rv;
+    }
+
+  };
+
+} //blofeld
+
+#endif // BLOFELD_COMPARTMENT_BATCH_H
@@ -10,7 +10,15 @@ namespace blofeld
   enum class ModelType
   {
     Deterministic,  // Uses double and simple maths
-    Stochastic      // Uses int and random sampling
+    Stochastic,     // Uses int and random sampling
+    Hybrid          // Uses double: deterministic above a threshold and random sampling (of integers) below it
+  };
+
+  enum class Integrator
+  {
+    FixedStep,      // One update per time step (proportions or binomial draws)
+    TauLeap,        // Adaptive tau-leaping within each time step (Stochastic only)
+    Exact           // Exact event-by-event simulation within each time step (Stochastic only)
   };
 
   enum class ContainerType
@@ -45,6 +53,16 @@ namespace blofeld
     }
   };
   
+  // Whether functions that only call stop() for invalid input or logic errors are noexcept:  not in debug
+  // mode, and not for thread-safe bridges, whose stop() throws WorkerStopped on a worker thread so that
+  // the error is reported by the main thread (rather than std::terminate being called):
+  template <auto s_cts>
+  consteval auto noexcept_release()
+    -> bool
+  {
+    return !s_cts.debug && !requires { requires decltype(s_cts)::Bridge::s_thread_safe; };
+  }
+  
   // Helper function (with default arguments - note that we use int not size_t for n)
   consteval CompartmentInfo compartment_info(int const n = 1, ContainerType const cont_type = ContainerType::Array, CarryType const carry_type = CarryType::Sequential)
   {
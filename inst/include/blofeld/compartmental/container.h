@@ -5,6 +5,9 @@
 #include <vector>
 #include <stdexcept>
 #include <concepts>
+#include <cstdint>
+#include <bit>
+#include <type_traits>
 
 #include "./compartment_types.h"
 
@@ -222,6 +225,81 @@ namespace blofeld
     template<typename Value>
     class Container<Value, ContainerType::BirthDeath, 1> : public Container<Value, ContainerType::Array, 1> {};
     
+    // Which elements of a container are non-zero (one bit each), so that long chains of mostly-empty
+    // sub-compartments can be iterated sparsely:  s_n is the (maximum) size for fixed-size containers
+    // Note: the owner must invalidate() this whenever the container is changed other than through set()
+    template<int s_n, bool s_resizeable>
+    class OccupancyMask
+    {
+    private:
+      static constexpr int s_bits = 64;
+      using Words = std::conditional_t<s_resizeable, std::vector<std::uint64_t>, std::array<std::uint64_t, (s_n+s_bits-1)/s_bits>>;
+      Words m_words {};
+      bool m_valid = false;
+      
+    public:
+      [[nodiscard]] constexpr auto valid() const noexcept
+        -> bool
+      {
+        return m_valid;
+      }
+      
+      constexpr auto invalidate() noexcept
+        -> void
+      {
+        m_valid = false;
+      }
+      
+      template <typename C>
+      constexpr auto build(C const& values)
+        -> void
+      {
+        if constexpr (s_resizeable) {
+          m_words.assign((values.size() + s_bits - 1U) / s_bits, 0U);
+        } else {
+          m_words.fill(0U);
+        }
+        int ii = 0;
+        for (auto const& val : values)
+        {
+          if (val != static_cast<std::remove_cvref_t<decltype(val)>>(0)) m_words[ii / s_bits] |= std::uint64_t{1} << (ii % s_bits);
+          ++ii;
+        }
+        m_valid = true;
+      }
+      
+      // Note: ignored until build() has been called (it will see the change anyway)
+      constexpr auto set(int const ii, bool const occupied) noexcept
+        -> void
+      {
+        if (!m_valid) return;
+        std::uint64_t const bit = std::uint64_t{1} << (ii % s_bits);
+        if (occupied) {
+          m_words[ii / s_bits] |= bit;
+        } else {
+          m_words[ii / s_bits] &= ~bit;
+        }
+      }
+      
+      // The first occupied element at or after ii, or n if there are none:
+      [[nodiscard]] constexpr auto next(int const ii, int const n) const noexcept
+        -> int
+      {
+        if (ii >= n) return n;
+        int ww = ii / s_bits;
+        std::uint64_t word = m_words[ww] & (~std::uint64_t{0} << (ii % s_bits));
+        int const nwords = static_cast<int>(std::ssize(m_words));
+        while (word == 0U)
+        {
+          if (++ww >= nwords) return n;
+          word = m_words[ww];
+        }
+        int const rv = ww * s_bits + std::countr_zero(word);
+        return rv < n ? rv : n;
+      }
+      
+    };
+
     // Not valid but e.g. ContainerBirthDeath = Container<Value, ContainerType::Array, 1> would be:
     // template<typename Value>
     // using Container<Value, ContainerType::BirthDeath, 1> = Container<Value, ContainerType::Array, 1>;
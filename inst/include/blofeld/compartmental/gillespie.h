@@ -0,0 +1,251 @@
+#ifndef BLOFELD_GILLESPIE_H
+#define BLOFELD_GILLESPIE_H
+
+#include <vector>
+#include <span>
+#include <cmath>
+#include <limits>
+
+#include "../utilities/tools.h"
+#include "../utilities/indexed_heap.h"
+#include "./transitions.h"
+
+/*
+  Exact stochastic simulation over a TransitionSet, with cost proportional to
+  the number of events rather than the number of fixed time steps:
+  - Direct:        Gillespie's direct method, with incremental propensity
+                   updates and a linear search to select the transition
+  - NextReaction:  Gibson & Bruck's next reaction method, with putative
+                   firing times held in an IndexedHeap and re-scaled when
+                   the propensity of a transition changes
+  After each event only the transitions leaving the affected species (plus
+  the infection transitions if the force of infection changed) are updated.
+*/
+
+namespace blofeld
+{
+
+  enum class ExactMethod
+  {
+    Direct,
+    NextReaction
+  };
+
+  class Gillespie
+  {
+  private:
+    ExactMethod m_method = ExactMethod::Direct;
+
+    // Dependency graph: transitions leaving each species (CSR), and all infection transitions:
+    std::vector<int> m_dep_start;
+    std::vector<int> m_dep;
+    std::vector<int> m_infection;
+    std::vector<int> m_fill;
+
+    // Working state, re-used between calls:
+    std::vector<double> m_propensity;
+    std::vector<double> m_time;
+    std::vector<int> m_affected;
+    std::vector<long> m_stamp;
+    IndexedHeap m_heap;
+    double m_force = 0.0;
+
+    long m_n_events = 0;
+
+    // Full recalculation of a0 every so often to stop rounding error accumulating (Direct only):
+    static constexpr int s_refresh = 1000;
+    static constexpr double s_infinity = std::numeric_limits<double>::infinity();
+
+    template <class Bridge>
+    [[nodiscard]] static auto rexp(Bridge& bridge, double const rate)
+      -> double
+    {
+      return -std::log1p(-bridge.runif()) / rate;
+    }
+
+    auto prepare(TransitionSet const& transitions)
+      -> void
+    {
+      int const ns = transitions.nSpecies();
+      int const nt = transitions.nTransitions();
+
+      m_dep_start.assign(ns+1, 0);
+      m_infection.clear();
+      for (int j=0; j<nt; ++j)
+      {
+        Transition const& tt = transitions.transition(j);
+        m_dep_start[tt.from+1]++;
+        if (tt.infection) m_infection.push_back(j);
+      }
+      for (int i=0; i<ns; ++i)
+      {
+        m_dep_start[i+1] += m_dep_start[i];
+      }
+      m_dep.resize(nt);
+      m_fill.assign(m_dep_start.begin(), m_dep_start.end()-1);
+      for (int j=0; j<nt; ++j)
+      {
+        m_dep[m_fill[transitions.transition(j).from]++] = j;
+      }
+
+      m_propensity.resize(nt);
+      m_time.resize(nt);
+      m_stamp.assign(nt, -1);
+      m_affected.reserve(nt);
+    }
+
+    // Collect (without duplicates) the transitions whose propensity may have changed after firing j:
+    auto collectAffected(TransitionSet const& transitions, int const j)
+      -> void
+    {
+      m_affected.clear();
+      auto add = [&](int const k) {
+        if (m_stamp[k] == m_n_events) return;
+        m_stamp[k] = m_n_events;
+        m_affected.push_back(k);
+      };
+      add(j);
+      Transition const& tt = transitions.transition(j);
+      for (int d=m_dep_start[tt.from]; d<m_dep_start[tt.from+1]; ++d) add(m_dep[d]);
+      if (tt.to >= 0) {
+        for (int d=m_dep_start[tt.to]; d<m_dep_start[tt.to+1]; ++d) add(m_dep[d]);
+      }
+      if (transitions.changesForce(j)) {
+        m_force = transitions.force();
+        for (int const k : m_infection) add(k);
+      }
+    }
+
+    template <class Bridge>
+    auto advanceDirect(Bridge& bridge, TransitionSet& transitions, double const duration)
+      -> void
+    {
+      double a0 = transitions.propensities(m_propensity);
+      m_force = transitions.force();
+      int since_refresh = 0;
+
+      double time = 0.0;
+      while (a0 > 0.0)
+      {
+        time += rexp(bridge, a0);
+        if (time >= duration) break;
+
+        // Select the transition (falling back to the last positive propensity in case of rounding):
+        double const target = bridge.runif() * a0;
+        double cumulative = 0.0;
+        int j = -1;
+        for (index k=0; k<ssize(m_propensity); ++k)
+        {
+          if (m_propensity[k] <= 0.0) continue;
+          cumulative += m_propensity[k];
+          j = static_cast<int>(k);
+          if (target < cumulative) break;
+        }
+        if (j < 0) break;
+
+        transitions.fire(j, 1);
+        m_n_events++;
+
+        collectAffected(transitions, j);
+        for (int const k : m_affected)
+        {
+          double const anew = transitions.propensity(k, m_force);
+          a0 += anew - m_propensity[k];
+          m_propensity[k] = anew;
+        }
+
+        if (++since_refresh >= s_refresh) {
+          a0 = transitions.propensities(m_propensity);
+          since_refresh = 0;
+        }
+      }
+    }
+
+    template <class Bridge>
+    auto advanceNextReaction(Bridge& bridge, TransitionSet& transitions, double const duration)
+      -> void
+    {
+      // Putative times are re-drawn at the start of every call (valid as they are memoryless):
+      transitions.propensities(m_propensity);
+      m_force = transitions.force();
+      for (index k=0; k<ssize(m_propensity); ++k)
+      {
+        m_time[k] = m_propensity[k] > 0.0 ? rexp(bridge, m_propensity[k]) : s_infinity;
+      }
+      m_heap.build(m_time);
+      if (m_heap.empty()) return;
+
+      while (m_heap.topKey() < duration)
+      {
+        int const j = m_heap.top();
+        double const time = m_heap.topKey();
+
+        transitions.fire(j, 1);
+        m_n_events++;
+
+        collectAffected(transitions, j);
+        for (int const k : m_affected)
+        {
+          double const aold = m_propensity[k];
+          double const anew = transitions.propensity(k, m_force);
+          m_propensity[k] = anew;
+
+          double next = s_infinity;
+          if (anew > 0.0) {
+            if (k != j && aold > 0.0) {
+              // Re-use the remaining exponential time, re-scaled to the new propensity:
+              next = time + (aold / anew) * (m_heap.key(k) - time);
+            } else {
+              next = time + rexp(bridge, anew);
+            }
+          }
+          m_heap.update(k, next);
+        }
+      }
+    }
+
+  public:
+    Gillespie() = default;
+
+    explicit Gillespie(ExactMethod const method)
+      : m_method(method)
+    {
+    }
+
+    auto setMethod(ExactMethod const method) noexcept
+      -> void
+    {
+      m_method = method;
+    }
+
+    [[nodiscard]] auto getMethod() const noexcept
+      -> ExactMethod
+    {
+      return m_method;
+    }
+
+    // Diagnostics:
+    [[nodiscard]] auto nEvents() const noexcept
+      -> long
+    {
+      return m_n_events;
+    }
+
+    // Advance the transition set by duration, one event at a time:
+    template <class Bridge>
+    auto advance(Bridge& bridge, TransitionSet& transitions, double const duration)
+      -> void
+    {
+      prepare(transitions);
+      if (m_method == ExactMethod::Direct) {
+        advanceDirect(bridge, transitions, duration);
+      } else {
+        advanceNextReaction(bridge, transitions, duration);
+      }
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_GILLESPIE_H
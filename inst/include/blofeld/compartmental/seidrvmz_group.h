@@ -0,0 +1,733 @@
+#ifndef BLOFELD_SEIDRVMZ_GROUP_H
+#define BLOFELD_SEIDRVMZ_GROUP_H
+
+#include <array>
+#include <span>
+#include <cmath>
+#include <vector>
+#include <type_traits>
+
+#include "./group.h"
+#include "./compartment_types.h"
+#include "./compartment.h"
+#include "./transitions.h"
+#include "./tau_leap.h"
+#include "./gillespie.h"
+
+/*
+  Port of the legacy SEIDRVMZgroup to the new Compartment class (using the
+  legacy support methods), so that MatrixPopulation and GroupWrapper have a
+  group to work with.  The fixed-step update is unchanged; for stochastic
+  groups each time step can alternatively be integrated by tau-leaping or
+  exactly (event by event) over the same transitions (see setIntegrator).
+*/
+
+namespace blofeld
+{
+
+  enum class SEIDRVMZcomp
+  {
+    S, E, L, I, D, R, V, M
+  };
+
+  struct SEIDRVMZpars
+  {
+    // For getting and setting all parameter values
+    double beta_subclin = 0.0;    // Beta for L animals
+    double beta_clinical = 0.0;   // Beta for I animals
+    double contact_power = 1.0;   // Frequency vs density vs other dependence ( beta * S * I / N^contact_power)
+
+    double incubation = 0.0;      // From E (exposed, not infectious)
+    double progression = 0.0;     // From L (infectious, not clinical)
+    double recovery = 0.0;        // From I (infectious and clinical)
+    double healing = 0.0;         // From D (not infectious but clinical)
+    double reversion = 0.0;       // From R (immune)
+    double waning = 0.0;          // From V (vaccinated)
+
+    double vaccination = 0.0;     // Random vaccination rate (S, R, V only) - TODO: remove
+    double mortality_E = 0.0;     // Disease-related mortality for Es
+    double mortality_L = 0.0;     // Disease-related mortality for Ls
+    double mortality_I = 0.0;     // Disease-related mortality for Is
+    double mortality_D = 0.0;     // Disease-related mortality for Ds
+    double death = 0.0;           // Other-cause mortality (also for E/L/I/D)
+
+    double d_time = 1.0;          // Time step
+  };
+
+  template <auto s_cts, ModelType s_mtype, CompartmentInfo s_ci_S, CompartmentInfo s_ci_E, CompartmentInfo s_ci_L, CompartmentInfo s_ci_I, CompartmentInfo s_ci_D, CompartmentInfo s_ci_R, CompartmentInfo s_ci_V, CompartmentInfo s_ci_M, CompartmentInfo s_ci_Z>
+  struct SEIDRVMZstate
+  {
+    // For getting only:  always full state
+    // Setting is done for specific compartments separately
+    double time = 0.0;
+    Compartment<s_cts, s_mtype, s_ci_S> S;   // Susceptible
+    Compartment<s_cts, s_mtype, s_ci_E> E;   // Exposed but not infectious or clinical
+    Compartment<s_cts, s_mtype, s_ci_L> L;   // Infectious but not clinical
+    Compartment<s_cts, s_mtype, s_ci_I> I;   // Infectious and clinical
+    Compartment<s_cts, s_mtype, s_ci_D> D;   // Not infectious but clinical
+    Compartment<s_cts, s_mtype, s_ci_R> R;   // Recovered - immune from reinfection
+    Compartment<s_cts, s_mtype, s_ci_V> V;   // Vaccinated - immune with probability ve_susceptible
+    Compartment<s_cts, s_mtype, s_ci_M> M;   // Dead from disease
+  };
+
+  template <auto s_cts, ModelType s_mtype, CompartmentInfo s_ci_S, CompartmentInfo s_ci_E, CompartmentInfo s_ci_L, CompartmentInfo s_ci_I, CompartmentInfo s_ci_D, CompartmentInfo s_ci_R, CompartmentInfo s_ci_V, CompartmentInfo s_ci_M, CompartmentInfo s_ci_Z>
+  class SEIDRVMZgroup : public Group<s_cts>
+  {
+  public:
+    using Bridge = decltype(s_cts)::Bridge;
+
+    using t_Value = std::conditional_t<s_mtype == ModelType::Stochastic, int, double>;
+
+  private:
+    Bridge& m_bridge;
+
+    static_assert(s_ci_S.is_active(), "SEIDRVMZgroup must have an S compartment");
+    static_assert(s_ci_Z.container_type == ContainerType::BirthDeath || s_ci_Z.container_type == ContainerType::Disabled, "SEIDRVMZgroup requires Z to be BirthDeath (or Disabled)");
+
+    double m_time = 0.0;
+    Compartment<s_cts, s_mtype, s_ci_S> m_S;
+    Compartment<s_cts, s_mtype, s_ci_E> m_E;
+    Compartment<s_cts, s_mtype, s_ci_L> m_L;
+    Compartment<s_cts, s_mtype, s_ci_I> m_I;
+    Compartment<s_cts, s_mtype, s_ci_D> m_D;
+    Compartment<s_cts, s_mtype, s_ci_R> m_R;
+    Compartment<s_cts, s_mtype, s_ci_V> m_V;
+    Compartment<s_cts, s_mtype, s_ci_M> m_M;
+    Compartment<s_cts, s_mtype, s_ci_Z> m_Z;
+
+    static constexpr bool s_have_death = s_ci_Z.is_active();
+    static constexpr bool s_have_vacc = s_ci_V.is_active();
+    static constexpr bool s_have_mort = s_ci_M.is_active();
+
+    // Parameters:
+    double m_beta_subclin = 0.1;
+    double m_beta_clinical = 0.1;
+    double m_contact_power = 1.0;
+    double m_incubation = 0.1;
+    double m_progression = 0.1;
+    double m_recovery = 0.1;
+    double m_healing = 0.1;
+    double m_reversion = 0.1;
+    double m_waning = 0.1;
+    double m_vaccination = 0.01;
+    double m_mortality_E = 0.01;
+    double m_mortality_L = 0.01;
+    double m_mortality_I = 0.01;
+    double m_mortality_D = 0.01;
+    double m_death = 0.001;
+
+    SEIDRVMZpars m_pars {
+      .beta_subclin = m_beta_subclin,
+      .beta_clinical = m_beta_clinical,
+      .contact_power = m_contact_power,
+      .incubation = m_incubation,
+      .progression = m_progression,
+      .recovery = m_recovery,
+      .healing = m_healing,
+      .reversion = m_reversion,
+      .waning = m_waning,
+      .vaccination = m_vaccination,
+      .mortality_E = m_mortality_E,
+      .mortality_L = m_mortality_L,
+      .mortality_I = m_mortality_I,
+      .mortality_D = m_mortality_D,
+      .death = m_death,
+      .d_time = 1.0
+    };
+
+    double m_external_infection = 0.0;
+
+    // Do we have death?
+    static constexpr std::size_t s_psd = s_have_death ? 1U : 0U;
+    // The expected array size from process_rate for non-EID compartments:
+    static constexpr std::size_t s_psv = s_have_vacc ? s_psd+1U : s_psd;
+    // The expected array size from process_rate for EID compartments:
+    static constexpr std::size_t s_psm = s_have_mort ? s_psd+1U : s_psd;
+
+    // Death is always first, then vaccine (but for R it restarts R, not goes to V)
+    std::array<double,s_psv> m_deathvacc_S_rate {};
+    std::array<double,s_psv> m_deathvacc_R_rate {};
+    std::array<double,s_psv> m_deathvacc_V_rate {};
+
+    // Death is always first, then mortality/cull:
+    std::array<double,s_psm> m_deathmort_E_rate {};
+    std::array<double,s_psm> m_deathmort_L_rate {};
+    std::array<double,s_psm> m_deathmort_I_rate {};
+    std::array<double,s_psm> m_deathmort_D_rate {};
+
+    // Continuous-time integration (Stochastic only):
+    Integrator m_integrator = Integrator::FixedStep;
+    TransitionSet m_transitions;
+    std::array<int, 8> m_block {};    // Block in m_transitions for S,E,L,I,D,R,V,M (-1 if disabled)
+    TauLeap m_tau_leap;
+    Gillespie m_gillespie;
+
+    auto checkBalance()
+      -> void
+    {
+      if constexpr (s_cts.debug) {
+        auto const total = m_S.get_sum() + m_E.get_sum() + m_L.get_sum() + m_I.get_sum() + m_D.get_sum() + m_R.get_sum() + m_V.get_sum() + m_M.get_sum();
+        if (std::abs(m_Z.get_sum() - total) > s_cts.tol) {
+          m_bridge.stop("Imbalance detected: total = {}; Z = {}", total, m_Z.get_sum());
+        }
+      }
+    }
+
+    // Rounding below the hybrid threshold changes compartment totals, so this must be balanced against Z:
+    [[nodiscard]] auto takeHybridResidual()
+      -> double
+    {
+      double residual = 0.0;
+      if constexpr (s_mtype == ModelType::Hybrid) {
+        residual += m_S.takeResidual();
+        if constexpr (s_ci_E.is_active()) residual += m_E.takeResidual();
+        if constexpr (s_ci_L.is_active()) residual += m_L.takeResidual();
+        if constexpr (s_ci_I.is_active()) residual += m_I.takeResidual();
+        if constexpr (s_ci_D.is_active()) residual += m_D.takeResidual();
+        if constexpr (s_ci_R.is_active()) residual += m_R.takeResidual();
+        if constexpr (s_ci_V.is_active()) residual += m_V.takeResidual();
+        if constexpr (s_ci_M.is_active()) residual += m_M.takeResidual();
+      }
+      return residual;
+    }
+
+    // Add a block of species for an active compartment, returning the block index (or -1 if disabled):
+    template <CompartmentInfo s_ci>
+    auto addBlock(Compartment<s_cts, s_mtype, s_ci> const& comp, double const infectivity, bool const alive, bool const infective)
+      -> int
+    {
+      if constexpr (!s_ci.is_active()) {
+        return -1;
+      } else {
+        int const block = m_transitions.addBlock(static_cast<int>(comp.size()), infectivity, alive, infective);
+        auto const values = comp.getValues();
+        m_transitions.setBlock(block, std::span<int const>(values.data(), values.size()));
+        return block;
+      }
+    }
+
+    // Add the Erlang carry through a block, plus the takes from every sub-compartment:
+    template <std::size_t s_nt>
+    auto addFlows(int const block, int const size, double const carry_rate, bool const infection, int const carry_to, std::array<double, s_nt> const& take_rate, std::array<int, s_nt> const& take_to)
+      -> void
+    {
+      if (block < 0) return;
+      int const first = m_transitions.first(block);
+      for (int k=0; k<size; ++k)
+      {
+        int const from = first + k;
+        int const to = (k < size-1) ? from+1 : carry_to;
+        if (infection || carry_rate > 0.0) {
+          m_transitions.addTransition(Transition { .from = from, .to = to, .rate = carry_rate * static_cast<double>(size), .infection = infection });
+        }
+        for (std::size_t t=0U; t<s_nt; ++t)
+        {
+          if (take_rate[t] > 0.0) {
+            m_transitions.addTransition(Transition { .from = from, .to = take_to[t], .rate = take_rate[t], .infection = false });
+          }
+        }
+      }
+    }
+
+    // Copy a block back to its compartment:
+    template <typename C>
+    auto storeBlock(C& comp, int const block)
+      -> void
+    {
+      if (block < 0) return;
+      auto values = comp.getValues();
+      m_transitions.getBlock(block, std::span<int>(values.data(), values.size()));
+      comp.setValues(values);
+    }
+
+    // One time step by tau-leaping or exact simulation, using the same transitions as the fixed-step update:
+    auto update_continuous()
+      -> void
+    {
+      if ( (m_Z.get_sum() - m_M.get_sum()) <= 0 ) {
+        m_time += m_pars.d_time;
+        return;
+      }
+
+      // Rates are per time step, so we advance by 1:
+      TransitionSet& transitions = beginContinuous();
+      if (m_integrator == Integrator::TauLeap) {
+        m_tau_leap.advance(m_bridge, transitions, 1.0);
+      } else {
+        m_gillespie.advance(m_bridge, transitions, 1.0);
+      }
+      endContinuous(1.0);
+    }
+
+  public:
+
+    using Tpars = SEIDRVMZpars;
+    using Tstate = SEIDRVMZstate<s_cts, s_mtype, s_ci_S, s_ci_E, s_ci_L, s_ci_I, s_ci_D, s_ci_R, s_ci_V, s_ci_M, s_ci_Z>;
+
+    SEIDRVMZgroup(Bridge& bridge)
+      : m_bridge(bridge), m_S(bridge), m_E(bridge), m_L(bridge), m_I(bridge),
+        m_D(bridge), m_R(bridge), m_V(bridge), m_M(bridge), m_Z(bridge)
+    {
+      // TODO: fix hack:
+      set_parameters(get_parameters());
+      validate();
+    }
+
+    void validate() const
+    {
+      // TODO: checks that we always have an S
+    }
+
+    void set_parameters(SEIDRVMZpars const& pars)
+    {
+      m_pars = pars;
+
+      // Note:  this does NOT get adjusted by d_time!!!!
+      m_contact_power = pars.contact_power;
+
+      m_beta_subclin = pars.beta_subclin * pars.d_time;
+      m_beta_clinical = pars.beta_clinical * pars.d_time;
+      m_incubation = pars.incubation * pars.d_time;
+      m_progression = pars.progression * pars.d_time;
+      m_recovery = pars.recovery * pars.d_time;
+      m_healing = pars.healing * pars.d_time;
+      m_reversion = pars.reversion * pars.d_time;
+      m_waning = pars.waning * pars.d_time;
+      m_vaccination = pars.vaccination * pars.d_time;
+      m_mortality_E = pars.mortality_E * pars.d_time;
+      m_mortality_L = pars.mortality_L * pars.d_time;
+      m_mortality_I = pars.mortality_I * pars.d_time;
+      m_mortality_D = pars.mortality_D * pars.d_time;
+      m_death = pars.death * pars.d_time;
+
+      if constexpr (s_have_death) {
+        m_deathvacc_S_rate[s_psd-1] = m_death;
+        m_deathvacc_R_rate[s_psd-1] = m_death;
+        m_deathvacc_V_rate[s_psd-1] = m_death;
+
+        m_deathmort_E_rate[s_psd-1] = m_death;
+        m_deathmort_L_rate[s_psd-1] = m_death;
+        m_deathmort_I_rate[s_psd-1] = m_death;
+        m_deathmort_D_rate[s_psd-1] = m_death;
+      }
+
+      if constexpr (s_have_vacc) {
+        m_deathvacc_S_rate[s_psv-1] = m_vaccination;
+        m_deathvacc_R_rate[s_psv-1] = m_vaccination;
+        m_deathvacc_V_rate[s_psv-1] = m_vaccination;
+      }
+
+      if constexpr (s_have_mort) {
+        m_deathmort_E_rate[s_psm-1] = m_mortality_E;
+        m_deathmort_L_rate[s_psm-1] = m_mortality_L;
+        m_deathmort_I_rate[s_psm-1] = m_mortality_I;
+        m_deathmort_D_rate[s_psm-1] = m_mortality_D;
+      }
+
+      validate();
+    }
+
+    auto get_parameters() const
+      -> SEIDRVMZpars
+    {
+      validate();
+
+      return m_pars;
+    }
+
+    void set_external_infection(double const extinf)
+    {
+      m_external_infection = extinf * m_pars.d_time;
+    }
+
+    auto get_external_infection() const
+      -> double
+    {
+      return m_external_infection;
+    }
+
+    // Choose between fixed-step and tau-leaping updates:
+    auto setIntegrator(Integrator const integrator)
+      -> void
+    {
+      if (s_mtype != ModelType::Stochastic && integrator != Integrator::FixedStep) {
+        m_bridge.stop("Only Integrator::FixedStep is available for deterministic and hybrid groups");
+      }
+      m_integrator = integrator;
+    }
+
+    [[nodiscard]] auto getIntegrator() const noexcept
+      -> Integrator
+    {
+      return m_integrator;
+    }
+
+    auto setTauLeapOptions(TauLeapOptions const& options)
+      -> void
+    {
+      m_tau_leap.setOptions(options);
+    }
+
+    [[nodiscard]] auto getTauLeap() const noexcept
+      -> TauLeap const&
+    {
+      return m_tau_leap;
+    }
+
+    auto setExactMethod(ExactMethod const method)
+      -> void
+    {
+      m_gillespie.setMethod(method);
+    }
+
+    [[nodiscard]] auto getGillespie() const noexcept
+      -> Gillespie const&
+    {
+      return m_gillespie;
+    }
+
+    // Build the continuous-time transitions from the current state (rates are per time step):
+    auto beginContinuous()
+      -> TransitionSet&
+      requires (s_mtype == ModelType::Stochastic)
+    {
+      // Species blocks, in compartment order:
+      m_transitions.clear();
+      m_transitions.setContactPower(m_contact_power);
+      m_transitions.setExternalInfection(m_external_infection);
+      int const bS = addBlock(m_S, 0.0, true, false);
+      int const bE = addBlock(m_E, 0.0, true, false);
+      int const bL = addBlock(m_L, m_beta_subclin, true, false);
+      int const bI = addBlock(m_I, m_beta_clinical, true, true);
+      int const bD = addBlock(m_D, 0.0, true, true);
+      int const bR = addBlock(m_R, 0.0, true, false);
+      int const bV = addBlock(m_V, 0.0, true, false);
+      int const bM = addBlock(m_M, 0.0, false, false);
+      m_block = { bS, bE, bL, bI, bD, bR, bV, bM };
+
+      // Destinations, with the carry skipping disabled compartments and R/V returning to S:
+      auto const start = [&](int const block) { return block < 0 ? -1 : m_transitions.first(block); };
+      auto const next = [&](std::initializer_list<int> const blocks) {
+        for (int const block : blocks)
+        {
+          if (block >= 0) return start(block);
+        }
+        return start(bS);
+      };
+      int const death = -1;
+      int const vacc = start(bV);
+      int const mort = start(bM);
+
+      auto const deathvacc = [&](int const restart) {
+        std::array<int, s_psv> rv {};
+        if constexpr (s_have_death) rv[s_psd-1] = death;
+        if constexpr (s_have_vacc) rv[s_psv-1] = restart;
+        return rv;
+      };
+      auto const deathmort = [&]() {
+        std::array<int, s_psm> rv {};
+        if constexpr (s_have_death) rv[s_psd-1] = death;
+        if constexpr (s_have_mort) rv[s_psm-1] = mort;
+        return rv;
+      };
+
+      addFlows(bS, static_cast<int>(m_S.size()), 1.0, true, next({bE, bL, bI, bD, bR}), m_deathvacc_S_rate, deathvacc(vacc));
+      addFlows(bE, static_cast<int>(m_E.size()), m_incubation, false, next({bL, bI, bD, bR}), m_deathmort_E_rate, deathmort());
+      addFlows(bL, static_cast<int>(m_L.size()), m_progression, false, next({bI, bD, bR}), m_deathmort_L_rate, deathmort());
+      addFlows(bI, static_cast<int>(m_I.size()), m_recovery, false, next({bD, bR}), m_deathmort_I_rate, deathmort());
+      addFlows(bD, static_cast<int>(m_D.size()), m_healing, false, next({bR}), m_deathmort_D_rate, deathmort());
+      // Note: deliberately restart R rather than go to V for vaccine effect:
+      addFlows(bR, static_cast<int>(m_R.size()), m_reversion, false, start(bS), m_deathvacc_R_rate, deathvacc(start(bR)));
+      // Note: restart V if re-vaccinated:
+      addFlows(bV, static_cast<int>(m_V.size()), m_waning, false, start(bS), m_deathvacc_V_rate, deathvacc(vacc));
+
+      return m_transitions;
+    }
+
+    // Write back the state after the transitions have been advanced by n_steps time steps:
+    auto endContinuous(double const n_steps)
+      -> void
+      requires (s_mtype == ModelType::Stochastic)
+    {
+      storeBlock(m_S, m_block[0]);
+      storeBlock(m_E, m_block[1]);
+      storeBlock(m_L, m_block[2]);
+      storeBlock(m_I, m_block[3]);
+      storeBlock(m_D, m_block[4]);
+      storeBlock(m_R, m_block[5]);
+      storeBlock(m_V, m_block[6]);
+      storeBlock(m_M, m_block[7]);
+      if constexpr (s_have_death) m_Z.set_sum(m_Z.get_sum() - m_transitions.removed(), false);
+      m_time += n_steps * m_pars.d_time;
+
+      checkBalance();
+    }
+
+    auto get_state() const
+      -> Tstate
+    {
+      Tstate state { m_time, m_S, m_E, m_L, m_I, m_D, m_R, m_V, m_M };
+      return state;
+    }
+
+    // Total of a single compartment, without copying the state:
+    [[nodiscard]] auto getTotal(SEIDRVMZcomp const compartment) const
+      -> t_Value
+    {
+      switch (compartment)
+      {
+        case SEIDRVMZcomp::S: return m_S.get_sum();
+        case SEIDRVMZcomp::E: return m_E.get_sum();
+        case SEIDRVMZcomp::L: return m_L.get_sum();
+        case SEIDRVMZcomp::I: return m_I.get_sum();
+        case SEIDRVMZcomp::D: return m_D.get_sum();
+        case SEIDRVMZcomp::R: return m_R.get_sum();
+        case SEIDRVMZcomp::V: return m_V.get_sum();
+        case SEIDRVMZcomp::M: return m_M.get_sum();
+      }
+      m_bridge.stop("Unrecognised compartment value in getTotal");
+      return static_cast<t_Value>(0);
+    }
+
+    [[nodiscard]] auto getTime() const noexcept
+      -> double
+    {
+      return m_time;
+    }
+
+    void set_state(SEIDRVMZcomp compartment, t_Value value, bool distribute)
+    {
+      if (compartment == SEIDRVMZcomp::S) {
+        m_S.set_sum(value, distribute);
+      } else if (compartment == SEIDRVMZcomp::E) {
+        m_E.set_sum(value, distribute);
+      } else if (compartment == SEIDRVMZcomp::L) {
+        m_L.set_sum(value, distribute);
+      } else if (compartment == SEIDRVMZcomp::I) {
+        m_I.set_sum(value, distribute);
+      } else if (compartment == SEIDRVMZcomp::D) {
+        m_D.set_sum(value, distribute);
+      } else if (compartment == SEIDRVMZcomp::R) {
+        m_R.set_sum(value, distribute);
+      } else if (compartment == SEIDRVMZcomp::V) {
+        m_V.set_sum(value, distribute);
+      } else if (compartment == SEIDRVMZcomp::M) {
+        m_M.set_sum(value, distribute);
+      } else {
+        m_bridge.stop("Unrecognised compartment value in set_state");
+      }
+
+      // Note: Z is re-calculated here so any rounding from distribute is already balanced:
+      static_cast<void>(takeHybridResidual());
+      m_Z.set_sum(m_S.get_sum() + m_E.get_sum() + m_L.get_sum() + m_I.get_sum() + m_D.get_sum() + m_R.get_sum() + m_V.get_sum() + m_M.get_sum());
+      if constexpr (s_cts.debug) { validate(); }
+    }
+
+    void update(int const n_steps = 1)
+    {
+      if constexpr (s_cts.debug) { validate(); }
+      for (int i=0; i<n_steps; ++i)
+      {
+        update_one();
+      }
+      if constexpr (s_cts.debug) { validate(); }
+    }
+
+    void update_one()
+    {
+      if constexpr (s_mtype == ModelType::Stochastic) {
+        if (m_integrator != Integrator::FixedStep) {
+          update_continuous();
+          return;
+        }
+      }
+
+      m_time += m_pars.d_time;
+
+      if ( (m_Z.get_sum() - m_M.get_sum()) <= 0 ) return;
+
+      // TODO: calculate only when contact power or Z/M change:
+      double const freqdens = static_cast<double>(std::pow((m_Z.get_sum() - m_M.get_sum()), m_contact_power));
+      double const inf_rate = m_external_infection + ((m_beta_subclin * static_cast<double>(m_L.get_sum()) + m_beta_clinical * static_cast<double>(m_I.get_sum())) / freqdens);
+
+      // We always have S:
+      auto const S_carry = [&](){
+        auto const [carry, take] = m_S.process_rate(inf_rate, m_deathvacc_S_rate);
+        if constexpr (s_have_death) m_Z.insert_value_start(-take[0]);
+        if constexpr (s_have_vacc) m_V.insert_value_start(take[s_have_death ? 1 : 0]);
+        return carry;
+      }();
+
+      // We don't always have E:
+      auto const E_carry = [&](auto const input){
+        if constexpr (s_ci_E.is_active()) {
+          m_E.insert_value_start(input);
+          auto const [carry, take] = m_E.process_rate(m_incubation, m_deathmort_E_rate);
+          if constexpr (s_have_death) m_Z.insert_value_start(-take[0]);
+          if constexpr (s_have_mort) m_M.insert_value_start(take[s_have_death ? 1 : 0]);
+          return carry;
+        } else {
+          return input;
+        }
+      }(S_carry);
+
+      // We don't always have L:
+      auto const L_carry = [&](auto const input){
+        if constexpr (s_ci_L.is_active()) {
+          m_L.insert_value_start(input);
+          auto const [carry, take] = m_L.process_rate(m_progression, m_deathmort_L_rate);
+          if constexpr (s_have_death) m_Z.insert_value_start(-take[0]);
+          if constexpr (s_have_mort) m_M.insert_value_start(take[s_have_death ? 1 : 0]);
+          return carry;
+        } else {
+          return input;
+        }
+      }(E_carry);
+
+      // We don't always have I:
+      auto const I_carry = [&](auto const input){
+        if constexpr (s_ci_I.is_active()) {
+          m_I.insert_value_start(input);
+          auto const [carry, take] = m_I.process_rate(m_recovery, m_deathmort_I_rate);
+          if constexpr (s_have_death) m_Z.insert_value_start(-take[0]);
+          if constexpr (s_have_mort) m_M.insert_value_start(take[s_have_death ? 1 : 0]);
+          return carry;
+        } else {
+          return input;
+        }
+      }(L_carry);
+
+      // We don't always have D:
+      auto const D_carry = [&](auto const input){
+        if constexpr (s_ci_D.is_active()) {
+          m_D.insert_value_start(input);
+          auto const [carry, take] = m_D.process_rate(m_healing, m_deathmort_D_rate);
+          if constexpr (s_have_death) m_Z.insert_value_start(-take[0]);
+          if constexpr (s_have_mort) m_M.insert_value_start(take[s_have_death ? 1 : 0]);
+          return carry;
+        } else {
+          return input;
+        }
+      }(I_carry);
+
+      // We don't always have R:
+      auto const R_carry = [&](auto const input){
+        if constexpr (s_ci_R.is_active()) {
+          m_R.insert_value_start(input);
+          auto const [carry, take] = m_R.process_rate(m_reversion, m_deathvacc_R_rate);
+          if constexpr (s_have_death) m_Z.insert_value_start(-take[0]);
+          // Note: deliberately restart R rather than go to V for vaccine effect:
+          if constexpr (s_have_vacc) m_R.insert_value_start(take[s_have_death ? 1 : 0]);
+          return carry;
+        } else {
+          return input;
+        }
+      }(D_carry);
+
+      // TODO: allow V to become infected
+      auto const V_carry = [&](){
+        if constexpr (s_ci_V.is_active()) {
+          auto const [carry, take] = m_V.process_rate(m_waning, m_deathvacc_V_rate);
+          if constexpr (s_have_death) m_Z.insert_value_start(-take[0]);
+          // Note: restart V if re-vaccinated:
+          if constexpr (s_have_vacc) m_V.insert_value_start(take[s_have_death ? 1 : 0]);
+          return carry;
+        } else {
+          return static_cast<t_Value>(0.0);
+        }
+      }();
+
+      m_S.insert_value_start(V_carry + R_carry);
+
+      m_S.apply_changes();
+      if constexpr (s_ci_E.is_active()) m_E.apply_changes();
+      if constexpr (s_ci_L.is_active()) m_L.apply_changes();
+      if constexpr (s_ci_I.is_active()) m_I.apply_changes();
+      if constexpr (s_ci_D.is_active()) m_D.apply_changes();
+      if constexpr (s_ci_R.is_active()) m_R.apply_changes();
+      if constexpr (s_ci_V.is_active()) m_V.apply_changes();
+      if constexpr (s_ci_M.is_active()) m_M.apply_changes();
+      if constexpr (s_mtype == ModelType::Hybrid && s_have_death) m_Z.insert_value_start(-takeHybridResidual());
+      m_Z.apply_changes();
+
+      checkBalance();
+    }
+
+    [[nodiscard]] auto getInfective() const
+      -> t_Value
+    {
+      t_Value inf = m_I.get_sum();
+      if constexpr (s_ci_D.is_active()) {
+        inf += m_D.get_sum();
+      }
+      return inf;
+    }
+
+    // Quiescent means that the only possible change is death from S:  no external infection (as set for the
+    // last update), nobody in E/L/I/D/R/V, no vaccination, and fixed-step updates
+    // Note: hybrid groups are never quiescent, as their deaths from S also move a residual between compartments
+    [[nodiscard]] auto isQuiescent() const
+      -> bool
+    {
+      if constexpr (s_mtype == ModelType::Hybrid) return false;
+      if (m_external_infection != 0.0 || m_integrator != Integrator::FixedStep) return false;
+      if constexpr (s_have_vacc) {
+        if (m_vaccination != 0.0) return false;
+      }
+      t_Value const others = m_E.get_sum() + m_L.get_sum() + m_I.get_sum() + m_D.get_sum() + m_R.get_sum() + m_V.get_sum();
+      return others == static_cast<t_Value>(0);
+    }
+
+    // The values of each sub-compartment of S, and the proportion of them dying per step, for a quiescent
+    // group (so that a population can realise the deaths itself, see QuiescentPath):
+    [[nodiscard]] auto getQuiescentS() const
+      -> std::vector<double>
+    {
+      auto const values = m_S.getValuesV();
+      return std::vector<double>(values.begin(), values.end());
+    }
+
+    // Note: not const, as the compartment may cache the proportion
+    [[nodiscard]] auto getQuiescentDeath()
+      -> double
+    {
+      if ( (m_Z.get_sum() - m_M.get_sum()) <= 0 ) return 0.0;
+      if constexpr (s_have_death) {
+        return m_S.makeTakeProp(m_death);
+      } else {
+        return 0.0;
+      }
+    }
+
+    // Equivalent to update(n_steps) for a quiescent group, given the survivors in each sub-compartment of S:
+    void advanceQuiescent(int const n_steps, std::span<double const> const survivors)
+    {
+      if constexpr (s_cts.debug) {
+        if (!isQuiescent()) m_bridge.stop("advanceQuiescent called for a group that is not quiescent");
+        if (ssize(survivors) != static_cast<index>(m_S.size())) m_bridge.stop("advanceQuiescent called with the wrong number of survivors");
+      }
+      if (n_steps <= 0) return;
+      // Note: time is added step by step so that it is identical to the time of groups updated every step
+      for (int i=0; i<n_steps; ++i) m_time += m_pars.d_time;
+
+      auto values = m_S.getValues();
+      t_Value removed = static_cast<t_Value>(0);
+      for (index j=0; j<ssize(survivors); ++j) {
+        t_Value const remaining = static_cast<t_Value>(survivors[j]);
+        removed += values[j] - remaining;
+        values[j] = remaining;
+      }
+      if (removed == static_cast<t_Value>(0)) return;
+      m_S.setValues(values);
+      auto zz = m_Z.getValues();
+      zz[0] -= removed;
+      m_Z.setValues(zz);
+
+      checkBalance();
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_SEIDRVMZ_GROUP_H
@@ -0,0 +1,282 @@
+#ifndef BLOFELD_TAU_LEAP_H
+#define BLOFELD_TAU_LEAP_H
+
+#include <vector>
+#include <span>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "../utilities/tools.h"
+#include "./transitions.h"
+
+/*
+  Adaptive tau-leaping over a TransitionSet (Cao, Gillespie & Petzold, 2006):
+  - transitions that could exhaust their source within n_critical firings
+    are critical, and fire at most once per leap (as in the exact method)
+  - the leap for the remaining transitions is the largest tau for which the
+    expected relative change in every reactant is bounded by epsilon
+  - if that leap is not worth it (tau < exact_threshold / a0) then a burst
+    of exact_steps exact (direct method) steps is taken instead
+  - a leap that would make any count negative is rejected and tau halved
+  Each call to advance moves the set forward by a fixed duration, so this can
+  replace a single fixed time step within a group.
+*/
+
+namespace blofeld
+{
+
+  struct TauLeapOptions
+  {
+    double epsilon = 0.03;          // Bound on relative change in propensities per leap
+    int n_critical = 10;            // Firings before a transition is considered critical
+    double exact_threshold = 10.0;  // Use exact steps when tau < exact_threshold / a0
+    int exact_steps = 100;          // Number of exact steps to take before re-trying a leap
+  };
+
+  class TauLeap
+  {
+  private:
+    TauLeapOptions m_options;
+
+    // Scratch space, re-used between calls:
+    std::vector<double> m_propensity;
+    std::vector<char> m_critical;
+    std::vector<int> m_fired;
+    std::vector<int> m_change;
+    std::vector<double> m_mu;
+    std::vector<double> m_sigma2;
+    std::vector<int> m_order;
+
+    // Counters for diagnostics:
+    long m_n_leaps = 0;
+    long m_n_exact = 0;
+    long m_n_rejected = 0;
+
+    static constexpr double s_infinity = std::numeric_limits<double>::infinity();
+
+    template <class Bridge>
+    [[nodiscard]] static auto rexp(Bridge& bridge, double const rate)
+      -> double
+    {
+      return -std::log1p(-bridge.runif()) / rate;
+    }
+
+    // Choose transition with probability proportional to its propensity (optionally critical only):
+    template <class Bridge>
+    [[nodiscard]] auto choose(Bridge& bridge, double const total, bool const critical_only) const
+      -> int
+    {
+      double const target = bridge.runif() * total;
+      double cumulative = 0.0;
+      int last = -1;
+      for (index j=0; j<ssize(m_propensity); ++j)
+      {
+        if (critical_only && !m_critical[j]) continue;
+        if (m_propensity[j] <= 0.0) continue;
+        cumulative += m_propensity[j];
+        last = static_cast<int>(j);
+        if (target < cumulative) break;
+      }
+      return last;
+    }
+
+    // Highest order of any reaction depending on each species (infection is second order in S and the infectives):
+    auto setOrders(TransitionSet const& transitions)
+      -> void
+    {
+      m_order.assign(transitions.nSpecies(), 0);
+      for (int j=0; j<transitions.nTransitions(); ++j)
+      {
+        Transition const& tt = transitions.transition(j);
+        m_order[tt.from] = std::max(m_order[tt.from], tt.infection ? 2 : 1);
+      }
+      for (int i=0; i<transitions.nSpecies(); ++i)
+      {
+        if (transitions.infectivity(i) > 0.0) m_order[i] = 2;
+      }
+    }
+
+    // Largest leap for the non-critical transitions (CGP 2006, eq. 33):
+    [[nodiscard]] auto selectTau(TransitionSet const& transitions)
+      -> double
+    {
+      std::fill(m_mu.begin(), m_mu.end(), 0.0);
+      std::fill(m_sigma2.begin(), m_sigma2.end(), 0.0);
+      for (int j=0; j<transitions.nTransitions(); ++j)
+      {
+        if (m_critical[j] || m_propensity[j] <= 0.0) continue;
+        Transition const& tt = transitions.transition(j);
+        m_mu[tt.from] -= m_propensity[j];
+        m_sigma2[tt.from] += m_propensity[j];
+        if (tt.to >= 0) {
+          m_mu[tt.to] += m_propensity[j];
+          m_sigma2[tt.to] += m_propensity[j];
+        }
+      }
+
+      double tau = s_infinity;
+      for (int i=0; i<transitions.nSpecies(); ++i)
+      {
+        if (m_order[i] == 0) continue;
+        double const bound = std::max(m_options.epsilon * static_cast<double>(transitions.count(i)) / static_cast<double>(m_order[i]), 1.0);
+        if (m_mu[i] != 0.0) tau = std::min(tau, bound / std::abs(m_mu[i]));
+        if (m_sigma2[i] > 0.0) tau = std::min(tau, bound * bound / m_sigma2[i]);
+      }
+      return tau;
+    }
+
+    // A single exact step of the direct method, returning the new time:
+    template <class Bridge>
+    auto exactStep(Bridge& bridge, TransitionSet& transitions, double const time, double const duration)
+      -> double
+    {
+      double const a0 = transitions.propensities(m_propensity);
+      if (a0 <= 0.0) return duration;
+      double const dt = rexp(bridge, a0);
+      if (time + dt >= duration) return duration;
+
+      int const j = choose(bridge, a0, false);
+      if (j >= 0) transitions.fire(j, 1);
+      m_n_exact++;
+      return time + dt;
+    }
+
+  public:
+    TauLeap() = default;
+
+    explicit TauLeap(TauLeapOptions const& options)
+      : m_options(options)
+    {
+    }
+
+    auto setOptions(TauLeapOptions const& options) noexcept
+      -> void
+    {
+      m_options = options;
+    }
+
+    [[nodiscard]] auto getOptions() const noexcept
+      -> TauLeapOptions
+    {
+      return m_options;
+    }
+
+    // Diagnostics:
+    [[nodiscard]] auto nLeaps() const noexcept
+      -> long
+    {
+      return m_n_leaps;
+    }
+    [[nodiscard]] auto nExact() const noexcept
+      -> long
+    {
+      return m_n_exact;
+    }
+    [[nodiscard]] auto nRejected() const noexcept
+      -> long
+    {
+      return m_n_rejected;
+    }
+
+    // Advance the transition set by duration:
+    template <class Bridge>
+    auto advance(Bridge& bridge, TransitionSet& transitions, double const duration)
+      -> void
+    {
+      int const nt = transitions.nTransitions();
+      int const ns = transitions.nSpecies();
+      m_propensity.resize(nt);
+      m_critical.resize(nt);
+      m_fired.resize(nt);
+      m_change.resize(ns);
+      m_mu.resize(ns);
+      m_sigma2.resize(ns);
+      setOrders(transitions);
+
+      double time = 0.0;
+      while (time < duration)
+      {
+        double const a0 = transitions.propensities(m_propensity);
+        if (a0 <= 0.0) break;
+
+        // Critical transitions (every transition consumes one individual from its source):
+        double a0c = 0.0;
+        for (int j=0; j<nt; ++j)
+        {
+          m_critical[j] = m_propensity[j] > 0.0 && transitions.count(transitions.transition(j).from) < m_options.n_critical;
+          if (m_critical[j]) a0c += m_propensity[j];
+        }
+
+        double tau1 = selectTau(transitions);
+
+        // Fall back to exact steps if leaping would not gain much:
+        if (tau1 < m_options.exact_threshold / a0) {
+          for (int k=0; k<m_options.exact_steps && time < duration; ++k)
+          {
+            time = exactStep(bridge, transitions, time, duration);
+          }
+          continue;
+        }
+
+        double const remaining = duration - time;
+        while (true)
+        {
+          double const tau2 = a0c > 0.0 ? rexp(bridge, a0c) : s_infinity;
+          bool fire_critical = tau2 <= tau1;
+          double tau = std::min(tau1, tau2);
+          if (tau >= remaining) {
+            tau = remaining;
+            fire_critical = false;
+          }
+
+          // Propose the number of firings for each transition:
+          std::fill(m_fired.begin(), m_fired.end(), 0);
+          for (int j=0; j<nt; ++j)
+          {
+            if (!m_critical[j] && m_propensity[j] > 0.0) m_fired[j] = bridge.rpois(m_propensity[j] * tau);
+          }
+          if (fire_critical) {
+            int const j = choose(bridge, a0c, true);
+            if (j >= 0) m_fired[j] = 1;
+          }
+
+          // Reject (and halve tau1) if any count would go negative:
+          std::fill(m_change.begin(), m_change.end(), 0);
+          for (int j=0; j<nt; ++j)
+          {
+            if (m_fired[j] == 0) continue;
+            Transition const& tt = transitions.transition(j);
+            m_change[tt.from] -= m_fired[j];
+            if (tt.to >= 0) m_change[tt.to] += m_fired[j];
+          }
+          bool feasible = true;
+          for (int i=0; i<ns; ++i)
+          {
+            if (transitions.count(i) + m_change[i] < 0) {
+              feasible = false;
+              break;
+            }
+          }
+          if (!feasible) {
+            m_n_rejected++;
+            tau1 /= 2.0;
+            continue;
+          }
+
+          for (int j=0; j<nt; ++j)
+          {
+            if (m_fired[j] > 0) transitions.fire(j, m_fired[j]);
+          }
+          m_n_leaps++;
+          time = tau == remaining ? duration : time + tau;
+          break;
+        }
+      }
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_TAU_LEAP_H
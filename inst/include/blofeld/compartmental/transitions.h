@@ -0,0 +1,278 @@
+#ifndef BLOFELD_TRANSITIONS_H
+#define BLOFELD_TRANSITIONS_H
+
+#include <vector>
+#include <span>
+#include <cmath>
+#include <numeric>
+
+#include "../utilities/tools.h"
+
+/*
+  A continuous-time view of a group, for use by event-based integrators:
+  every sub-compartment is a species holding an integer count, and every flow
+  between sub-compartments is a first-order transition with propensity
+  rate * count (multiplied by the current force of infection for infection
+  transitions).  Species are organised into blocks (one per compartment) with
+  running totals, so that the force of infection is O(blocks) to evaluate:
+
+    force = external + sum(infectivity * total) / sum(alive * total)^contact_power
+
+  The integrators only need propensities and state changes, so this is
+  independent of the Compartment classes that the group uses for storage.
+*/
+
+namespace blofeld
+{
+
+  struct Transition
+  {
+    int from;           // Source species
+    int to;             // Destination species, or -1 for removal (death)
+    double rate;        // Per-individual rate, per unit time
+    bool infection;     // If true then the rate is multiplied by the force of infection
+  };
+
+  class TransitionSet
+  {
+  private:
+    struct Block
+    {
+      int first = 0;
+      int size = 0;
+      double infectivity = 0.0;
+      bool alive = true;
+      bool infective = false;
+      int total = 0;
+    };
+
+    std::vector<Block> m_blocks;
+    std::vector<int> m_block_of;
+    std::vector<int> m_state;
+    std::vector<Transition> m_transitions;
+
+    double m_external_infection = 0.0;
+    double m_contact_power = 1.0;
+    int m_removed = 0;
+
+  public:
+    TransitionSet() = default;
+
+    /* Structure */
+
+    // Remove all blocks and transitions (but keep the allocated memory):
+    auto clear() noexcept
+      -> void
+    {
+      m_blocks.clear();
+      m_block_of.clear();
+      m_state.clear();
+      m_transitions.clear();
+      m_removed = 0;
+    }
+
+    // Add a block of size species, returning the block index (infective blocks are counted by infectiveTotal):
+    auto addBlock(int const size, double const infectivity = 0.0, bool const alive = true, bool const infective = false)
+      -> int
+    {
+      int const first = static_cast<int>(ssize(m_state));
+      m_blocks.push_back(Block { .first = first, .size = size, .infectivity = infectivity, .alive = alive, .infective = infective, .total = 0 });
+      int const block = static_cast<int>(ssize(m_blocks)) - 1;
+      m_block_of.insert(m_block_of.end(), size, block);
+      m_state.insert(m_state.end(), size, 0);
+      return block;
+    }
+
+    // Add a transition (transitions within a species are ignored):
+    auto addTransition(Transition const& transition)
+      -> void
+    {
+      if (transition.from == transition.to) return;
+      m_transitions.push_back(transition);
+    }
+
+    auto setExternalInfection(double const external_infection) noexcept
+      -> void
+    {
+      m_external_infection = external_infection;
+    }
+
+    auto setContactPower(double const contact_power) noexcept
+      -> void
+    {
+      m_contact_power = contact_power;
+    }
+
+    [[nodiscard]] auto first(int const block) const
+      -> int
+    {
+      return m_blocks[block].first;
+    }
+
+    [[nodiscard]] auto infectivity(int const species) const
+      -> double
+    {
+      return m_blocks[m_block_of[species]].infectivity;
+    }
+
+    [[nodiscard]] auto alive(int const species) const
+      -> bool
+    {
+      return species >= 0 && m_blocks[m_block_of[species]].alive;
+    }
+
+    // Does firing transition j change the force of infection?
+    [[nodiscard]] auto changesForce(int const j) const
+      -> bool
+    {
+      Transition const& tt = m_transitions[j];
+      if (infectivity(tt.from) > 0.0) return true;
+      if (tt.to >= 0 && infectivity(tt.to) > 0.0) return true;
+      return m_contact_power != 0.0 && alive(tt.from) != alive(tt.to);
+    }
+
+    [[nodiscard]] auto nSpecies() const noexcept
+      -> int
+    {
+      return static_cast<int>(ssize(m_state));
+    }
+
+    [[nodiscard]] auto nTransitions() const noexcept
+      -> int
+    {
+      return static_cast<int>(ssize(m_transitions));
+    }
+
+    [[nodiscard]] auto transition(int const j) const
+      -> Transition const&
+    {
+      return m_transitions[j];
+    }
+
+
+    /* State */
+
+    // Set the counts for a block from a span of the right size:
+    auto setBlock(int const block, std::span<int const> const values)
+      -> void
+    {
+      Block& bb = m_blocks[block];
+      std::copy(values.begin(), values.end(), m_state.begin() + bb.first);
+      bb.total = std::accumulate(values.begin(), values.end(), 0);
+    }
+
+    // Copy the counts for a block to a span of the right size:
+    auto getBlock(int const block, std::span<int> const values) const
+      -> void
+    {
+      Block const& bb = m_blocks[block];
+      std::copy(m_state.begin() + bb.first, m_state.begin() + bb.first + bb.size, values.begin());
+    }
+
+    [[nodiscard]] auto count(int const species) const
+      -> int
+    {
+      return m_state[species];
+    }
+
+    [[nodiscard]] auto blockTotal(int const block) const
+      -> int
+    {
+      return m_blocks[block].total;
+    }
+
+    // Total in infective blocks (as seen by other groups):
+    [[nodiscard]] auto infectiveTotal() const
+      -> int
+    {
+      int rv = 0;
+      for (auto const& bb : m_blocks)
+      {
+        if (bb.infective) rv += bb.total;
+      }
+      return rv;
+    }
+
+    // Does firing transition j change the infective total?
+    [[nodiscard]] auto changesInfective(int const j) const
+      -> bool
+    {
+      Transition const& tt = m_transitions[j];
+      bool const from = m_blocks[m_block_of[tt.from]].infective;
+      bool const to = tt.to >= 0 && m_blocks[m_block_of[tt.to]].infective;
+      return from != to;
+    }
+
+    // Number removed (to == -1) since the last clear or resetRemoved:
+    [[nodiscard]] auto removed() const noexcept
+      -> int
+    {
+      return m_removed;
+    }
+
+    auto resetRemoved() noexcept
+      -> void
+    {
+      m_removed = 0;
+    }
+
+
+    /* Propensities and events */
+
+    [[nodiscard]] auto force() const
+      -> double
+    {
+      double infectious = 0.0;
+      double alive = 0.0;
+      for (auto const& bb : m_blocks)
+      {
+        infectious += bb.infectivity * static_cast<double>(bb.total);
+        if (bb.alive) alive += static_cast<double>(bb.total);
+      }
+      if (alive <= 0.0) return m_external_infection;
+      return m_external_infection + infectious / std::pow(alive, m_contact_power);
+    }
+
+    // Propensity of transition j, given the current force of infection:
+    [[nodiscard]] auto propensity(int const j, double const force) const
+      -> double
+    {
+      Transition const& tt = m_transitions[j];
+      double const rate = tt.infection ? tt.rate * force : tt.rate;
+      return rate * static_cast<double>(m_state[tt.from]);
+    }
+
+    // Fill all propensities, returning the total:
+    auto propensities(std::span<double> const out) const
+      -> double
+    {
+      double const ff = force();
+      double total = 0.0;
+      for (index j=0; j<ssize(m_transitions); ++j)
+      {
+        out[j] = propensity(static_cast<int>(j), ff);
+        total += out[j];
+      }
+      return total;
+    }
+
+    // Fire transition j count times (the caller is responsible for count <= count(from)):
+    auto fire(int const j, int const count)
+      -> void
+    {
+      Transition const& tt = m_transitions[j];
+      m_state[tt.from] -= count;
+      m_blocks[m_block_of[tt.from]].total -= count;
+      if (tt.to >= 0) {
+        m_state[tt.to] += count;
+        m_blocks[m_block_of[tt.to]].total += count;
+      } else {
+        m_removed += count;
+      }
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_TRANSITIONS_H
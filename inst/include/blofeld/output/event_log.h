@@ -0,0 +1,209 @@
+#ifndef BLOFELD_EVENT_LOG_H
+#define BLOFELD_EVENT_LOG_H
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+#include "../utilities/tools.h"
+#include "../compartmental/seidrvmz_group.h"
+#include "./trajectory_recorder.h"
+
+/*
+  Output as a log of changes:  after the initial state, a (time, group,
+  compartment, delta) event is recorded only when the total of a compartment
+  has changed since it was last observed, so groups that sit unchanged cost
+  nothing beyond the comparison of their (running) totals.  stateAt()
+  reconstructs the state of every group at any time from the initial state
+  and the events, starting from the nearest earlier checkpoint (a full copy
+  of the state, taken every so many events) so that queries late in a long
+  run do not need to replay every event.
+*/
+
+namespace blofeld
+{
+
+  template <class T_bridge, typename T_value>
+  class EventLog
+  {
+  public:
+    using Bridge = T_bridge;
+    using Value = T_value;
+
+  private:
+    Bridge& m_bridge;
+    std::vector<SEIDRVMZcomp> m_compartments;
+    int m_ngroups = 0;
+    index m_width = 0;
+    bool m_started = false;
+
+    // The initial state and the state as last observed, as [group][compartment]:
+    double m_initial_time = 0.0;
+    std::vector<Value> m_initial;
+    std::vector<Value> m_last;
+    std::vector<Value> m_frame;
+
+    // Events (the compartment is the index within m_compartments):
+    std::vector<double> m_time;
+    std::vector<int> m_group;
+    std::vector<std::uint8_t> m_compartment;
+    std::vector<Value> m_delta;
+
+    // Copies of the state after m_checkpoint_event[c] events:
+    index m_checkpoint_spacing = 0;
+    std::vector<index> m_checkpoint_event;
+    std::vector<std::vector<Value>> m_checkpoint_state;
+
+    EventLog() = delete;
+
+    void addEvents(double const time)
+    {
+      for (index i=0; i<m_width; ++i)
+      {
+        if (m_frame[i] == m_last[i]) continue;
+        m_time.push_back(time);
+        m_group.push_back(static_cast<int>(i / ssize(m_compartments)));
+        m_compartment.push_back(static_cast<std::uint8_t>(i % ssize(m_compartments)));
+        m_delta.push_back(m_frame[i] - m_last[i]);
+        m_last[i] = m_frame[i];
+      }
+
+      // Only checkpoint at the end of a time point, so that the events before it are complete:
+      index const since = nEvents() - (m_checkpoint_event.empty() ? 0 : m_checkpoint_event.back());
+      if (since >= m_checkpoint_spacing) {
+        m_checkpoint_event.push_back(nEvents());
+        m_checkpoint_state.push_back(m_last);
+      }
+    }
+
+  public:
+    // Note: a checkpoint costs as much memory as one full state, so they are at least 4 states' worth of events apart
+    explicit EventLog(Bridge& bridge, std::vector<SEIDRVMZcomp> const& compartments, int const n_groups)
+      : m_bridge(bridge), m_compartments(compartments), m_ngroups(n_groups)
+    {
+      if (n_groups < 1) m_bridge.stop("Invalid number of groups {}", n_groups);
+      if (compartments.empty()) m_bridge.stop("At least one compartment must be recorded");
+      m_width = static_cast<index>(n_groups) * ssize(compartments);
+      m_frame.assign(m_width, static_cast<Value>(0));
+      m_checkpoint_spacing = std::max<index>(65536, 4 * m_width);
+    }
+
+    // Observe the current state:  the first call records the initial state, and later calls any changes
+    template <class T>
+    void observe(T const& obj)
+    {
+      if (frameGroups(obj) != m_ngroups) {
+        m_bridge.stop("The number of groups ({}) does not match the event log ({})", frameGroups(obj), m_ngroups);
+      }
+      double const time = collectFrame(obj, std::span<SEIDRVMZcomp const>(m_compartments), std::span<Value>(m_frame));
+      if (!m_started) {
+        m_initial_time = time;
+        m_initial = m_frame;
+        m_last = m_frame;
+        m_started = true;
+        return;
+      }
+      if (!m_time.empty() && time < m_time.back()) m_bridge.stop("Time {} is before the last event at {}", time, m_time.back());
+      addEvents(time);
+    }
+
+    // Update and observe for the given number of steps (see runObserved):
+    template <class T>
+    void run(T& obj, int const steps)
+    {
+      if (steps < 0) m_bridge.stop("Invalid number of steps {}", steps);
+      if (!m_started) observe(std::as_const(obj));
+      runObserved(obj, *this, steps);
+    }
+
+    // State of every group at the given time (after any events at that time), as [group][compartment]:
+    [[nodiscard]] auto stateAt(double const time) const
+      -> std::vector<Value>
+    {
+      if (!m_started) m_bridge.stop("Nothing has been recorded");
+      if (time < m_initial_time) m_bridge.stop("Time {} is before the start of the log at {}", time, m_initial_time);
+
+      index const end = std::upper_bound(m_time.begin(), m_time.end(), time) - m_time.begin();
+
+      // Start from the last checkpoint at or before end:
+      auto const cp = std::upper_bound(m_checkpoint_event.begin(), m_checkpoint_event.end(), end);
+      index ev = 0;
+      std::vector<Value> rv;
+      if (cp == m_checkpoint_event.begin()) {
+        rv = m_initial;
+      } else {
+        index const cc = (cp - m_checkpoint_event.begin()) - 1;
+        rv = m_checkpoint_state[cc];
+        ev = m_checkpoint_event[cc];
+      }
+
+      index const ncomp = ssize(m_compartments);
+      for (; ev<end; ++ev)
+      {
+        rv[m_group[ev]*ncomp + m_compartment[ev]] += m_delta[ev];
+      }
+      return rv;
+    }
+
+    [[nodiscard]] auto nEvents() const noexcept
+      -> index
+    {
+      return ssize(m_time);
+    }
+
+    [[nodiscard]] auto nGroups() const noexcept
+      -> int
+    {
+      return m_ngroups;
+    }
+
+    [[nodiscard]] auto getCompartments() const noexcept
+      -> std::span<SEIDRVMZcomp const>
+    {
+      return m_compartments;
+    }
+
+    [[nodiscard]] auto getInitialTime() const noexcept
+      -> double
+    {
+      return m_initial_time;
+    }
+
+    [[nodiscard]] auto getInitial() const noexcept
+      -> std::span<Value const>
+    {
+      return m_initial;
+    }
+
+    [[nodiscard]] auto getTimes() const noexcept
+      -> std::span<double const>
+    {
+      return m_time;
+    }
+
+    [[nodiscard]] auto getGroups() const noexcept
+      -> std::span<int const>
+    {
+      return m_group;
+    }
+
+    // Index within getCompartments() of each event:
+    [[nodiscard]] auto getEventCompartments() const noexcept
+      -> std::span<std::uint8_t const>
+    {
+      return m_compartment;
+    }
+
+    [[nodiscard]] auto getDeltas() const noexcept
+      -> std::span<Value const>
+    {
+      return m_delta;
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_EVENT_LOG_H
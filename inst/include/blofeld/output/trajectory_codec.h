@@ -0,0 +1,312 @@
+#ifndef BLOFELD_TRAJECTORY_CODEC_H
+#define BLOFELD_TRAJECTORY_CODEC_H
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <algorithm>
+
+#include "../utilities/tools.h"
+#include "../compartmental/seidrvmz_group.h"
+#include "./trajectory_recorder.h"
+
+/*
+  Compression for integer (stochastic) trajectories, where most values change
+  by little or nothing between recorded steps.  Each frame (the values of all
+  groups and compartments at one time) is stored as the difference from the
+  previous frame, as a stream of variable-length integers:
+  - a non-zero difference d is written as zigzag(d) << 1 (so small positive and
+    negative changes both take a single byte)
+  - a run of z zero differences (including across frames) is written as
+    (z << 1) | 1, so unchanged groups cost almost nothing
+  Frames are grouped into blocks of a fixed number of records, where the first
+  frame of each block is relative to zero, so any record can be decoded from
+  the start of its block without decoding anything earlier.
+*/
+
+namespace blofeld
+{
+
+  namespace internal
+  {
+    [[nodiscard]] constexpr auto zigzag(std::int64_t const value) noexcept
+      -> std::uint64_t
+    {
+      return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    }
+
+    [[nodiscard]] constexpr auto unzigzag(std::uint64_t const value) noexcept
+      -> std::int64_t
+    {
+      return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1U);
+    }
+
+    inline void putVarint(std::vector<std::uint8_t>& bytes, std::uint64_t value)
+    {
+      while (value >= 0x80U)
+      {
+        bytes.push_back(static_cast<std::uint8_t>(value | 0x80U));
+        value >>= 7;
+      }
+      bytes.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    [[nodiscard]] inline auto getVarint(std::uint8_t const*& ptr) noexcept
+      -> std::uint64_t
+    {
+      std::uint64_t value = 0U;
+      for (int shift=0; ; shift+=7)
+      {
+        std::uint8_t const byte = *ptr++;
+        value |= static_cast<std::uint64_t>(byte & 0x7FU) << shift;
+        if (byte < 0x80U) break;
+      }
+      return value;
+    }
+  }
+
+  class TrajectoryCodec
+  {
+  private:
+    index m_width = 0;
+    index m_block = 0;
+
+    std::vector<std::uint8_t> m_bytes;
+    std::vector<std::size_t> m_block_start;
+    std::vector<double> m_time;
+
+    // The last frame appended, and the zero differences not yet written:
+    std::vector<int> m_previous;
+    std::uint64_t m_zeros = 0U;
+
+    void flushZeros()
+    {
+      if (m_zeros == 0U) return;
+      internal::putVarint(m_bytes, (m_zeros << 1) | 1U);
+      m_zeros = 0U;
+    }
+
+  public:
+    // Frames of width values, with a block starting every block_records records:
+    TrajectoryCodec(index const width, index const block_records)
+      : m_width(width), m_block(block_records)
+    {
+      m_previous.assign(width, 0);
+    }
+
+    void append(double const time, std::span<int const> const frame)
+    {
+      if (ssize(m_time) % m_block == 0) {
+        flushZeros();
+        m_block_start.push_back(m_bytes.size());
+        std::fill(m_previous.begin(), m_previous.end(), 0);
+      }
+      m_time.push_back(time);
+
+      for (index i=0; i<m_width; ++i)
+      {
+        std::int64_t const diff = static_cast<std::int64_t>(frame[i]) - static_cast<std::int64_t>(m_previous[i]);
+        if (diff == 0) {
+          m_zeros++;
+        } else {
+          flushZeros();
+          internal::putVarint(m_bytes, internal::zigzag(diff) << 1);
+        }
+      }
+      std::copy(frame.begin(), frame.end(), m_previous.begin());
+    }
+
+    // Decode count consecutive records from first, calling fun(record, frame) for each:
+    template <typename F>
+    void decode(index const first, index const count, F&& fun) const
+    {
+      if (count <= 0) return;
+      index record = (first / m_block) * m_block;
+      std::vector<int> frame(m_width, 0);
+
+      // Any pending zeros at the end are implied (decoding never reads beyond the last record):
+      std::uint8_t const* ptr = m_bytes.data() + m_block_start[first / m_block];
+      std::uint8_t const* const end = m_bytes.data() + m_bytes.size();
+      std::uint64_t zeros = 0U;
+      for (; record < first + count; ++record)
+      {
+        if (record % m_block == 0) {
+          ptr = m_bytes.data() + m_block_start[record / m_block];
+          std::fill(frame.begin(), frame.end(), 0);
+          zeros = 0U;
+        }
+        for (index i=0; i<m_width; ++i)
+        {
+          if (zeros > 0U) {
+            zeros--;
+            continue;
+          }
+          if (ptr == end) {
+            // The trailing run of zeros that has not been written yet:
+            continue;
+          }
+          std::uint64_t const token = internal::getVarint(ptr);
+          if (token & 1U) {
+            zeros = (token >> 1) - 1U;
+          } else {
+            frame[i] += static_cast<int>(internal::unzigzag(token >> 1));
+          }
+        }
+        if (record >= first) fun(record, std::span<int const>(frame));
+      }
+    }
+
+    [[nodiscard]] auto nRecords() const noexcept
+      -> index
+    {
+      return ssize(m_time);
+    }
+
+    [[nodiscard]] auto getTimes() const noexcept
+      -> std::span<double const>
+    {
+      return m_time;
+    }
+
+    [[nodiscard]] auto width() const noexcept
+      -> index
+    {
+      return m_width;
+    }
+
+    // Compressed size (excluding the times and block index):
+    [[nodiscard]] auto nBytes() const noexcept
+      -> std::size_t
+    {
+      return m_bytes.size();
+    }
+
+    void clear() noexcept
+    {
+      m_bytes.clear();
+      m_block_start.clear();
+      m_time.clear();
+      std::fill(m_previous.begin(), m_previous.end(), 0);
+      m_zeros = 0U;
+    }
+
+  };
+
+  // An in-memory recorder for integer trajectories using TrajectoryCodec:
+  template <class T_bridge>
+  class CompressedTrajectory
+  {
+  public:
+    using Bridge = T_bridge;
+    using Value = int;
+
+  private:
+    Bridge& m_bridge;
+    std::vector<SEIDRVMZcomp> m_compartments;
+    int m_ngroups = 0;
+    int m_interval = 1;
+    long m_calls = 0;
+
+    TrajectoryCodec m_codec;
+    std::vector<int> m_frame;
+
+    CompressedTrajectory() = delete;
+
+  public:
+    explicit CompressedTrajectory(Bridge& bridge, std::vector<SEIDRVMZcomp> const& compartments, int const n_groups, int const interval = 1, int const block_records = 64)
+      : m_bridge(bridge), m_compartments(compartments), m_ngroups(n_groups), m_interval(interval),
+        m_codec(static_cast<index>(n_groups) * ssize(compartments), std::max(block_records, 1))
+    {
+      if (interval < 1) m_bridge.stop("Invalid recording interval {}", interval);
+      if (n_groups < 1) m_bridge.stop("Invalid number of groups {}", n_groups);
+      if (compartments.empty()) m_bridge.stop("At least one compartment must be recorded");
+      if (block_records < 1) m_bridge.stop("Invalid block size {}", block_records);
+      m_frame.resize(static_cast<std::size_t>(m_codec.width()));
+    }
+
+    // Record the current state of every group now, irrespective of the interval:
+    template <class T>
+    void record(T const& obj)
+    {
+      if (frameGroups(obj) != m_ngroups) {
+        m_bridge.stop("The number of groups ({}) does not match the recorder ({})", frameGroups(obj), m_ngroups);
+      }
+      double const time = collectFrame(obj, std::span<SEIDRVMZcomp const>(m_compartments), std::span<int>(m_frame));
+      m_codec.append(time, m_frame);
+    }
+
+    // To be called after every time step:  records every interval-th call
+    template <class T>
+    void observe(T const& obj)
+    {
+      if (++m_calls % m_interval == 0) record(obj);
+    }
+
+    // Update and observe for the given number of steps (see runObserved):
+    template <class T>
+    void run(T& obj, int const steps)
+    {
+      if (steps < 0) m_bridge.stop("Invalid number of steps {}", steps);
+      runObserved(obj, *this, steps);
+    }
+
+    [[nodiscard]] auto nRecords() const noexcept
+      -> index
+    {
+      return m_codec.nRecords();
+    }
+
+    [[nodiscard]] auto nGroups() const noexcept
+      -> int
+    {
+      return m_ngroups;
+    }
+
+    [[nodiscard]] auto getCompartments() const noexcept
+      -> std::span<SEIDRVMZcomp const>
+    {
+      return m_compartments;
+    }
+
+    [[nodiscard]] auto getTimes() const noexcept
+      -> std::span<double const>
+    {
+      return m_codec.getTimes();
+    }
+
+    [[nodiscard]] auto nBytes() const noexcept
+      -> std::size_t
+    {
+      return m_codec.nBytes();
+    }
+
+    // Values for the given (0-based) groups over count records from first, as [record][group][compartment]
+    // (the same layout as TrajectoryReader::readSlice):
+    [[nodiscard]] auto readSlice(std::span<int const> const groups, index const first, index const count) const
+      -> std::vector<int>
+    {
+      if (first < 0 || count < 0 || first + count > nRecords()) {
+        m_bridge.stop("Records {} to {} out of range for {} records", first, first+count, nRecords());
+      }
+      for (int const gg : groups)
+      {
+        if (gg < 0 || gg >= m_ngroups) m_bridge.stop("Group {} out of range", gg);
+      }
+
+      index const ncomp = ssize(m_compartments);
+      std::vector<int> rv;
+      rv.reserve(static_cast<std::size_t>(count) * groups.size() * m_compartments.size());
+      m_codec.decode(first, count, [&](index, std::span<int const> const frame) {
+        for (int const gg : groups)
+        {
+          for (index k=0; k<ncomp; ++k) rv.push_back(frame[gg*ncomp + k]);
+        }
+      });
+      return rv;
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_TRAJECTORY_CODEC_H
@@ -0,0 +1,249 @@
+#ifndef BLOFELD_TRAJECTORY_RECORDER_H
+#define BLOFELD_TRAJECTORY_RECORDER_H
+
+#include <vector>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include "../utilities/tools.h"
+#include "../compartmental/seidrvmz_group.h"
+
+/*
+  Records selected compartment totals from a group or population as the
+  simulation runs, into preallocated columns (time, group and one column per
+  compartment), so that a whole trajectory is returned to R as a single
+  matrix or data frame rather than one data frame per time step.
+  Records are taken every interval-th call to observe() (or run(), which
+  updates and observes for a given number of steps), either for each group
+  of a population or for the population totals.
+*/
+
+namespace blofeld
+{
+
+  // Column names for SEIDRVMZcomp:
+  [[nodiscard]] constexpr auto compartmentName(SEIDRVMZcomp const compartment) noexcept
+    -> std::string_view
+  {
+    switch (compartment)
+    {
+      case SEIDRVMZcomp::S: return "S";
+      case SEIDRVMZcomp::E: return "E";
+      case SEIDRVMZcomp::L: return "L";
+      case SEIDRVMZcomp::I: return "I";
+      case SEIDRVMZcomp::D: return "D";
+      case SEIDRVMZcomp::R: return "R";
+      case SEIDRVMZcomp::V: return "V";
+      case SEIDRVMZcomp::M: return "M";
+    }
+    return "?";
+  }
+
+  // Number of groups in a population (or 1 for a single group):
+  template <class T>
+  [[nodiscard]] auto frameGroups(T const& obj)
+    -> int
+  {
+    if constexpr (requires (T const& pop) { pop.nGroups(); pop.getGroup(0); }) {
+      return obj.nGroups();
+    } else {
+      return 1;
+    }
+  }
+
+  // Write the compartment totals of every group of a population (or a single group) to frame,
+  // as [group][compartment], and return the time:
+  template <class T, typename Value>
+  auto collectFrame(T const& obj, std::span<SEIDRVMZcomp const> const compartments, std::span<Value> const frame)
+    -> double
+  {
+    index const ncomp = ssize(compartments);
+    auto const fill = [&](auto const& group, index const gg) {
+      for (index k=0; k<ncomp; ++k) frame[gg*ncomp + k] = static_cast<Value>(group.getTotal(compartments[k]));
+    };
+    if constexpr (requires (T const& pop) { pop.nGroups(); pop.getGroup(0); }) {
+      // Note: each group is read once, as a read-only getGroup may bring a copy of the group up to date
+      double time = 0.0;
+      for (int i=0; i<obj.nGroups(); ++i)
+      {
+        auto const& group = *obj.getGroup(i);
+        if (i == 0) time = group.getTime();
+        fill(group, i);
+      }
+      return time;
+    } else {
+      fill(obj, 0);
+      return obj.getTime();
+    }
+  }
+
+  // Update a group or population one step at a time for the given number of steps, observing after each
+  // (the run() of every output class, after its own checks and allocation):
+  template <class T, class T_sink>
+  void runObserved(T& obj, T_sink& sink, int const steps)
+  {
+    for (int i=0; i<steps; ++i)
+    {
+      obj.update(1);
+      sink.observe(std::as_const(obj));
+    }
+  }
+
+  template <class T_bridge, typename T_value>
+  class TrajectoryRecorder
+  {
+  public:
+    using Bridge = T_bridge;
+    using Value = T_value;
+
+  private:
+    Bridge& m_bridge;
+
+    std::vector<SEIDRVMZcomp> m_compartments;
+    int m_interval = 1;
+    bool m_by_group = true;
+    long m_calls = 0;
+
+    // Columns, all of length nRecords() (the group is -1 for population totals):
+    std::vector<double> m_time;
+    std::vector<int> m_group;
+    std::vector<std::vector<Value>> m_values;
+
+    TrajectoryRecorder() = delete;
+
+    template <class G>
+    void append(G const& group, int const groupnum)
+    {
+      m_time.push_back(group.getTime());
+      m_group.push_back(groupnum);
+      for (index k=0; k<ssize(m_compartments); ++k)
+      {
+        m_values[k].push_back(static_cast<Value>(group.getTotal(m_compartments[k])));
+      }
+    }
+
+  public:
+    explicit TrajectoryRecorder(Bridge& bridge, std::vector<SEIDRVMZcomp> const& compartments, int const interval = 1, bool const by_group = true)
+      : m_bridge(bridge), m_compartments(compartments), m_interval(interval), m_by_group(by_group)
+    {
+      if (interval < 1) m_bridge.stop("Invalid recording interval {}", interval);
+      if (compartments.empty()) m_bridge.stop("At least one compartment must be recorded");
+      m_values.resize(m_compartments.size());
+    }
+
+    // Pre-allocate space for a further n_records (so that recording does not re-allocate):
+    void reserve(index const n_records)
+    {
+      index const total = nRecords() + n_records;
+      m_time.reserve(total);
+      m_group.reserve(total);
+      for (auto& column : m_values) column.reserve(total);
+    }
+
+    // Discard everything recorded so far (keeping the allocated space):
+    void clear() noexcept
+    {
+      m_time.clear();
+      m_group.clear();
+      for (auto& column : m_values) column.clear();
+      m_calls = 0;
+    }
+
+    // Record the current state now, irrespective of the interval:
+    template <class T>
+    void record(T const& obj)
+    {
+      if constexpr (requires (T const& pop) { pop.nGroups(); pop.getGroup(0); }) {
+        int const ngroups = obj.nGroups();
+        if (m_by_group) {
+          for (int i=0; i<ngroups; ++i) append(*obj.getGroup(i), i);
+        } else if (ngroups > 0) {
+          // Note: each group is read once (see collectFrame), and added to the totals for every compartment
+          m_group.push_back(-1);
+          for (auto& column : m_values) column.push_back(static_cast<Value>(0));
+          for (int i=0; i<ngroups; ++i)
+          {
+            auto const& group = *obj.getGroup(i);
+            if (i == 0) m_time.push_back(group.getTime());
+            for (index k=0; k<ssize(m_compartments); ++k)
+            {
+              m_values[k].back() += static_cast<Value>(group.getTotal(m_compartments[k]));
+            }
+          }
+        }
+      } else {
+        append(obj, 0);
+      }
+    }
+
+    // To be called after every time step:  records every interval-th call
+    template <class T>
+    void observe(T const& obj)
+    {
+      if (++m_calls % m_interval == 0) record(obj);
+    }
+
+    // Update and observe for the given number of steps (see runObserved):
+    template <class T>
+    void run(T& obj, int const steps)
+    {
+      if (steps < 0) m_bridge.stop("Invalid number of steps {}", steps);
+      index per_record = 1;
+      if constexpr (requires (T const& pop) { pop.nGroups(); }) {
+        if (m_by_group) per_record = obj.nGroups();
+      }
+      reserve(((m_calls + steps) / m_interval - m_calls / m_interval) * per_record);
+
+      runObserved(obj, *this, steps);
+    }
+
+    [[nodiscard]] auto nRecords() const noexcept
+      -> index
+    {
+      return ssize(m_time);
+    }
+
+    [[nodiscard]] auto byGroup() const noexcept
+      -> bool
+    {
+      return m_by_group;
+    }
+
+    [[nodiscard]] auto getInterval() const noexcept
+      -> int
+    {
+      return m_interval;
+    }
+
+    [[nodiscard]] auto getCompartments() const noexcept
+      -> std::span<SEIDRVMZcomp const>
+    {
+      return m_compartments;
+    }
+
+    [[nodiscard]] auto getTimes() const noexcept
+      -> std::span<double const>
+    {
+      return m_time;
+    }
+
+    [[nodiscard]] auto getGroups() const noexcept
+      -> std::span<int const>
+    {
+      return m_group;
+    }
+
+    // Column for the k-th recorded compartment:
+    [[nodiscard]] auto getValues(index const k) const
+      -> std::span<Value const>
+    {
+      if (k < 0 || k >= ssize(m_values)) m_bridge.stop("Column {} out of range", k);
+      return m_values[k];
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_TRAJECTORY_RECORDER_H
@@ -0,0 +1,350 @@
+#ifndef BLOFELD_TRAJECTORY_STORE_H
+#define BLOFELD_TRAJECTORY_STORE_H
+
+#include <array>
+#include <vector>
+#include <span>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include "../utilities/tools.h"
+#include "../utilities/mapped_file.h"
+#include "../compartmental/seidrvmz_group.h"
+#include "./trajectory_recorder.h"
+
+/*
+  Disk-backed trajectories, for runs where every group's state at every time
+  step would not fit in memory.  The file is a fixed-size header (compartments,
+  number of groups and records) followed by fixed-width records, one per
+  recorded time step:  the time (double) then the value of each recorded
+  compartment for each group, as [group][compartment].  Values are int32 for
+  stochastic models and double otherwise, in native byte order.
+  - TrajectoryStore appends records through a memory map that grows as needed
+    (and is truncated to the records written by close)
+  - TrajectoryReader maps an existing file read-only, and copies out slices of
+    groups and records, so only the pages for the slice are ever loaded
+*/
+
+namespace blofeld
+{
+
+  struct TrajectoryHeader
+  {
+    std::array<char, 8> magic { 'B', 'L', 'F', 'D', 'T', 'R', 'J', '1' };
+    std::uint32_t version = 1U;
+    std::uint32_t value_type = 0U;        // 0 for int32, 1 for double
+    std::uint32_t n_compartments = 0U;
+    std::uint32_t n_groups = 0U;
+    std::uint64_t n_records = 0U;
+    std::uint64_t record_size = 0U;       // Bytes per record
+    std::uint64_t data_offset = 0U;       // Bytes before the first record
+    std::array<std::uint8_t, 8> compartments { };   // SEIDRVMZcomp of each column
+    std::array<std::uint8_t, 8> reserved { };
+  };
+  static_assert(std::is_trivially_copyable_v<TrajectoryHeader> && sizeof(TrajectoryHeader) == 64U, "Unexpected TrajectoryHeader layout");
+
+  template <class T_bridge, typename T_value>
+  class TrajectoryStore
+  {
+  public:
+    using Bridge = T_bridge;
+    using Value = T_value;
+
+  private:
+    static_assert(std::is_same_v<Value, int> || std::is_same_v<Value, double>, "TrajectoryStore values must be int or double");
+
+    Bridge& m_bridge;
+    MappedFile m_file;
+
+    TrajectoryHeader m_header;
+    std::vector<SEIDRVMZcomp> m_compartments;
+    int m_interval = 1;
+    long m_calls = 0;
+    std::uint64_t m_capacity = 0U;
+
+    // Values for the current record, as [group][compartment]:
+    std::vector<Value> m_frame;
+
+    // Records added to the file each time it needs to grow (at least):
+    static constexpr std::uint64_t s_min_growth = 64U;
+
+    TrajectoryStore() = delete;
+
+    void writeHeader()
+    {
+      std::memcpy(m_file.data(), &m_header, sizeof(TrajectoryHeader));
+    }
+
+    void ensureCapacity()
+    {
+      if (m_header.n_records < m_capacity) return;
+      m_capacity = std::max(m_capacity * 2U, m_capacity + s_min_growth);
+      if (!m_file.resize(m_header.data_offset + m_capacity * m_header.record_size)) {
+        m_bridge.stop("{}", m_file.error());
+      }
+    }
+
+    void append(double const time)
+    {
+      ensureCapacity();
+      std::byte* const rec = m_file.data() + m_header.data_offset + m_header.n_records * m_header.record_size;
+      std::memcpy(rec, &time, sizeof(double));
+      std::memcpy(rec + sizeof(double), m_frame.data(), m_frame.size() * sizeof(Value));
+      m_header.n_records++;
+    }
+
+  public:
+    explicit TrajectoryStore(Bridge& bridge, std::string const& path, std::vector<SEIDRVMZcomp> const& compartments, int const n_groups, int const interval = 1)
+      : m_bridge(bridge), m_compartments(compartments), m_interval(interval)
+    {
+      if (interval < 1) m_bridge.stop("Invalid recording interval {}", interval);
+      if (n_groups < 1) m_bridge.stop("Invalid number of groups {}", n_groups);
+      if (compartments.empty() || ssize(compartments) > ssize(m_header.compartments)) {
+        m_bridge.stop("Between 1 and {} compartments must be recorded", ssize(m_header.compartments));
+      }
+
+      m_header.value_type = std::is_same_v<Value, int> ? 0U : 1U;
+      m_header.n_compartments = static_cast<std::uint32_t>(compartments.size());
+      m_header.n_groups = static_cast<std::uint32_t>(n_groups);
+      m_header.record_size = sizeof(double) + static_cast<std::uint64_t>(n_groups) * compartments.size() * sizeof(Value);
+      m_header.data_offset = sizeof(TrajectoryHeader);
+      for (index k=0; k<ssize(compartments); ++k)
+      {
+        m_header.compartments[k] = static_cast<std::uint8_t>(compartments[k]);
+      }
+      m_frame.resize(static_cast<std::size_t>(n_groups) * compartments.size());
+
+      if (!m_file.open(path, true) || !m_file.resize(m_header.data_offset)) {
+        m_bridge.stop("{}", m_file.error());
+      }
+      writeHeader();
+    }
+
+    TrajectoryStore(TrajectoryStore const&) = delete;
+    TrajectoryStore& operator=(TrajectoryStore const&) = delete;
+
+    ~TrajectoryStore()
+    {
+      if (m_file.isOpen()) {
+        // Note: errors cannot be reported from here, so call close() to check
+        m_file.resize(m_header.data_offset + m_header.n_records * m_header.record_size);
+        writeHeader();
+      }
+    }
+
+    // Pre-allocate space in the file for a further n_records:
+    void reserve(std::uint64_t const n_records)
+    {
+      if (m_header.n_records + n_records <= m_capacity) return;
+      m_capacity = m_header.n_records + n_records;
+      if (!m_file.resize(m_header.data_offset + m_capacity * m_header.record_size)) {
+        m_bridge.stop("{}", m_file.error());
+      }
+    }
+
+    // Record the current state of every group now, irrespective of the interval:
+    template <class T>
+    void record(T const& obj)
+    {
+      if (frameGroups(obj) != static_cast<int>(m_header.n_groups)) {
+        m_bridge.stop("The number of groups ({}) does not match the store ({})", frameGroups(obj), m_header.n_groups);
+      }
+      append(collectFrame(obj, std::span<SEIDRVMZcomp const>(m_compartments), std::span<Value>(m_frame)));
+    }
+
+    // To be called after every time step:  records every interval-th call
+    template <class T>
+    void observe(T const& obj)
+    {
+      if (++m_calls % m_interval == 0) record(obj);
+    }
+
+    // Update and observe for the given number of steps (see runObserved):
+    template <class T>
+    void run(T& obj, int const steps)
+    {
+      if (steps < 0) m_bridge.stop("Invalid number of steps {}", steps);
+      reserve(static_cast<std::uint64_t>((m_calls + steps) / m_interval - m_calls / m_interval));
+      runObserved(obj, *this, steps);
+    }
+
+    // Update the header, so that the records so far can be read by another process:
+    void flush()
+    {
+      writeHeader();
+    }
+
+    // Truncate the file to the records written and close it:
+    void close()
+    {
+      if (!m_file.isOpen()) return;
+      if (!m_file.resize(m_header.data_offset + m_header.n_records * m_header.record_size)) {
+        m_bridge.stop("{}", m_file.error());
+      }
+      writeHeader();
+      m_file.close();
+    }
+
+    [[nodiscard]] auto nRecords() const noexcept
+      -> index
+    {
+      return static_cast<index>(m_header.n_records);
+    }
+
+  };
+
+
+  template <class T_bridge>
+  class TrajectoryReader
+  {
+  public:
+    using Bridge = T_bridge;
+
+  private:
+    Bridge& m_bridge;
+    MappedFile m_file;
+    TrajectoryHeader m_header;
+    std::vector<SEIDRVMZcomp> m_compartments;
+
+    TrajectoryReader() = delete;
+
+    [[nodiscard]] auto recordPtr(index const record) const noexcept
+      -> std::byte const*
+    {
+      return m_file.data() + m_header.data_offset + static_cast<std::uint64_t>(record) * m_header.record_size;
+    }
+
+    template <typename Value>
+    void copySlice(std::span<int const> const groups, index const first, index const count, std::span<double> const out) const
+    {
+      index const ncomp = ssize(m_compartments);
+      index oo = 0;
+      for (index r=first; r<first+count; ++r)
+      {
+        std::byte const* const values = recordPtr(r) + sizeof(double);
+        for (int const gg : groups)
+        {
+          for (index k=0; k<ncomp; ++k)
+          {
+            Value val;
+            std::memcpy(&val, values + (gg*ncomp + k) * static_cast<index>(sizeof(Value)), sizeof(Value));
+            out[oo++] = static_cast<double>(val);
+          }
+        }
+      }
+    }
+
+  public:
+    explicit TrajectoryReader(Bridge& bridge, std::string const& path)
+      : m_bridge(bridge)
+    {
+      if (!m_file.open(path, false)) m_bridge.stop("{}", m_file.error());
+      if (m_file.size() < sizeof(TrajectoryHeader)) m_bridge.stop("'{}' is not a trajectory file", path);
+      std::memcpy(&m_header, m_file.data(), sizeof(TrajectoryHeader));
+
+      TrajectoryHeader const expected;
+      if (m_header.magic != expected.magic) m_bridge.stop("'{}' is not a trajectory file", path);
+      if (m_header.version != expected.version) m_bridge.stop("Unsupported trajectory file version {}", m_header.version);
+      if (m_header.value_type > 1U || m_header.n_compartments < 1U || m_header.n_compartments > m_header.compartments.size()) {
+        m_bridge.stop("Corrupt trajectory file header in '{}'", path);
+      }
+      std::uint64_t const value_size = m_header.value_type == 0U ? sizeof(int) : sizeof(double);
+      if (m_header.record_size != sizeof(double) + static_cast<std::uint64_t>(m_header.n_groups) * m_header.n_compartments * value_size) {
+        m_bridge.stop("Corrupt trajectory file header in '{}'", path);
+      }
+      if (m_header.data_offset < sizeof(TrajectoryHeader) || m_header.data_offset > m_file.size()) {
+        m_bridge.stop("Corrupt trajectory file header in '{}'", path);
+      }
+      // Note: divide rather than multiply, so that a corrupt n_records cannot overflow
+      if ((m_file.size() - m_header.data_offset) / m_header.record_size < m_header.n_records) {
+        m_bridge.stop("Trajectory file '{}' is truncated", path);
+      }
+      for (std::uint32_t k=0U; k<m_header.n_compartments; ++k)
+      {
+        if (m_header.compartments[k] > static_cast<std::uint8_t>(SEIDRVMZcomp::M)) {
+          m_bridge.stop("Corrupt trajectory file header in '{}'", path);
+        }
+        m_compartments.push_back(static_cast<SEIDRVMZcomp>(m_header.compartments[k]));
+      }
+    }
+
+    [[nodiscard]] auto nRecords() const noexcept
+      -> index
+    {
+      return static_cast<index>(m_header.n_records);
+    }
+
+    [[nodiscard]] auto nGroups() const noexcept
+      -> int
+    {
+      return static_cast<int>(m_header.n_groups);
+    }
+
+    [[nodiscard]] auto isInteger() const noexcept
+      -> bool
+    {
+      return m_header.value_type == 0U;
+    }
+
+    [[nodiscard]] auto getCompartments() const noexcept
+      -> std::span<SEIDRVMZcomp const>
+    {
+      return m_compartments;
+    }
+
+    [[nodiscard]] auto getTime(index const record) const
+      -> double
+    {
+      if (record < 0 || record >= nRecords()) m_bridge.stop("Record {} out of range", record);
+      double time;
+      std::memcpy(&time, recordPtr(record), sizeof(double));
+      return time;
+    }
+
+    // The first record with time >= time (or nRecords() if there are none), assuming increasing times:
+    [[nodiscard]] auto findRecord(double const time) const
+      -> index
+    {
+      index lo = 0;
+      index hi = nRecords();
+      while (lo < hi)
+      {
+        index const mid = lo + (hi - lo) / 2;
+        if (getTime(mid) < time) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      return lo;
+    }
+
+    // Values for the given (0-based) groups over count records from first, as [record][group][compartment]:
+    [[nodiscard]] auto readSlice(std::span<int const> const groups, index const first, index const count) const
+      -> std::vector<double>
+    {
+      if (first < 0 || count < 0 || first + count > nRecords()) {
+        m_bridge.stop("Records {} to {} out of range for {} records", first, first+count, nRecords());
+      }
+      for (int const gg : groups)
+      {
+        if (gg < 0 || gg >= nGroups()) m_bridge.stop("Group {} out of range", gg);
+      }
+
+      std::vector<double> rv(static_cast<std::size_t>(count) * groups.size() * m_compartments.size());
+      if (isInteger()) {
+        copySlice<int>(groups, first, count, rv);
+      } else {
+        copySlice<double>(groups, first, count, rv);
+      }
+      return rv;
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_TRAJECTORY_STORE_H
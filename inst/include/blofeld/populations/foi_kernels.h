@@ -0,0 +1,158 @@
+#ifndef BLOFELD_FOI_KERNELS_H
+#define BLOFELD_FOI_KERNELS_H
+
+#include <span>
+#include <array>
+#include <algorithm>
+
+#include "../utilities/tools.h"
+
+/*
+  Force of infection kernels:  external[i] = sum_j beta(j -> i) * infective[j]
+
+  Dense beta is stored by target (beta[i*n + j] from group j to group i) so
+  that each row is a contiguous dot product with the infective vector:
+  - foiGemv:  one run;  4 target rows at a time share each load of the
+              infective vector, with sources in blocks that stay in L1 and
+              independent partial sums so that the inner loop vectorises
+  - foiGemm:  several replicates at once, with infective and external held
+              as [group][replicate] so that the innermost loop runs over
+              contiguous replicates (and each beta value is loaded once for
+              all replicates)
+  Sparse beta (CSR by source, as used by MatrixPopulation) has the
+  equivalent scatter kernels foiSpmv and foiSpmm.
+*/
+
+namespace blofeld
+{
+
+  namespace internal
+  {
+    // Sources per block, so that a block of infective (and 4 rows of beta) fits in L1:
+    inline constexpr index s_foi_block = 512;
+
+    // Target rows handled together by foiGemv:
+    inline constexpr index s_foi_rows = 4;
+
+    // Independent partial sums per row (allowing vectorisation without re-association):
+    inline constexpr index s_foi_lanes = 4;
+  }
+
+  // Dense, single run:
+  inline auto foiGemv(std::span<double const> const beta, index const n, std::span<double const> const infective, std::span<double> const external)
+    -> void
+  {
+    using namespace internal;
+
+    std::fill(external.begin(), external.end(), 0.0);
+
+    for (index jb=0; jb<n; jb+=s_foi_block)
+    {
+      index const je = std::min(jb + s_foi_block, n);
+      index const jv = jb + ((je - jb) / s_foi_lanes) * s_foi_lanes;
+
+      index i = 0;
+      for (; i + s_foi_rows <= n; i += s_foi_rows)
+      {
+        std::array<std::array<double, s_foi_lanes>, s_foi_rows> acc { };
+        for (index j=jb; j<jv; j+=s_foi_lanes)
+        {
+          for (index r=0; r<s_foi_rows; ++r)
+          {
+            double const* const row = beta.data() + (i+r)*n;
+            for (index l=0; l<s_foi_lanes; ++l)
+            {
+              acc[r][l] += row[j+l] * infective[j+l];
+            }
+          }
+        }
+        for (index r=0; r<s_foi_rows; ++r)
+        {
+          double const* const row = beta.data() + (i+r)*n;
+          double sum = 0.0;
+          for (index l=0; l<s_foi_lanes; ++l) sum += acc[r][l];
+          for (index j=jv; j<je; ++j) sum += row[j] * infective[j];
+          external[i+r] += sum;
+        }
+      }
+
+      // Remaining rows:
+      for (; i<n; ++i)
+      {
+        double const* const row = beta.data() + i*n;
+        double sum = 0.0;
+        for (index j=jb; j<je; ++j) sum += row[j] * infective[j];
+        external[i] += sum;
+      }
+    }
+  }
+
+  // Dense, nrep replicates with infective and external as [group][replicate]:
+  inline auto foiGemm(std::span<double const> const beta, index const n, index const nrep, std::span<double const> const infective, std::span<double> const external)
+    -> void
+  {
+    using namespace internal;
+
+    std::fill(external.begin(), external.end(), 0.0);
+
+    for (index jb=0; jb<n; jb+=s_foi_block)
+    {
+      index const je = std::min(jb + s_foi_block, n);
+      for (index i=0; i<n; ++i)
+      {
+        double const* const row = beta.data() + i*n;
+        double* const out = external.data() + i*nrep;
+        for (index j=jb; j<je; ++j)
+        {
+          double const bij = row[j];
+          if (bij == 0.0) continue;
+          double const* const inf = infective.data() + j*nrep;
+          for (index r=0; r<nrep; ++r)
+          {
+            out[r] += bij * inf[r];
+          }
+        }
+      }
+    }
+  }
+
+  // Sparse (CSR by source), single run:
+  inline auto foiSpmv(std::span<int const> const start, std::span<int const> const target, std::span<double const> const value, std::span<double const> const infective, std::span<double> const external)
+    -> void
+  {
+    std::fill(external.begin(), external.end(), 0.0);
+    for (index j=0; j<ssize(infective); ++j)
+    {
+      double const inf = infective[j];
+      if (inf == 0.0) continue;
+      for (int k=start[j]; k<start[j+1]; ++k)
+      {
+        external[target[k]] += inf * value[k];
+      }
+    }
+  }
+
+  // Sparse (CSR by source), nrep replicates with infective and external as [group][replicate]:
+  inline auto foiSpmm(std::span<int const> const start, std::span<int const> const target, std::span<double const> const value, index const nrep, std::span<double const> const infective, std::span<double> const external)
+    -> void
+  {
+    std::fill(external.begin(), external.end(), 0.0);
+    index const n = ssize(start) - 1;
+    for (index j=0; j<n; ++j)
+    {
+      double const* const inf = infective.data() + j*nrep;
+      for (int k=start[j]; k<start[j+1]; ++k)
+      {
+        double const bij = value[k];
+        double* const out = external.data() + static_cast<index>(target[k])*nrep;
+        for (index r=0; r<nrep; ++r)
+        {
+          out[r] += bij * inf[r];
+        }
+      }
+    }
+  }
+
+} // namespace blofeld
+
+#endif // BLOFELD_FOI_KERNELS_H
@@ -2,11 +2,25 @@
 #define MATRIX_POPULATION_H_
 
 #include <vector>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <concepts>
+#include <algorithm>
 
 // For now I am using Rcpp::NumericMatrix
 // #include <Rcpp>
 
 #include "../utilities/tools.h"
+#include "../utilities/indexed_heap.h"
+#include "../utilities/thread_pool.h"
+#include "../utilities/bridge_worker.h"
+#include "./foi_kernels.h"
+#include "./quiescent_path.h"
+#include "../compartmental/compartment_types.h"
+#include "../compartmental/transitions.h"
 
 /* This class takes groups and updates them using a beta matrix */
 
@@ -24,11 +38,279 @@ namespace blofeld
     
     std::vector<Group> m_groups;
     std::vector<double> m_infective;
-    std::vector<double> m_beta;
     
     double m_time = 0.0;
+    long m_step = 0;
+    long m_substeps = 0;
+    
+    Integrator m_integrator = Integrator::FixedStep;
+    
+    // Beta in compressed sparse row form, by source group:  the groups infected by group j are
+    // m_beta_target[m_beta_start[j]..m_beta_start[j+1]), with beta values in m_beta_value
+    // (so this is also the dependency graph for the external infection of each group)
+    std::vector<int> m_beta_start;
+    std::vector<int> m_beta_target;
+    std::vector<double> m_beta_value;
+    
+    // Dense copy of beta by target (beta[i*n+j] from j to i), kept only when beta is dense enough to benefit:
+    // Note: when it is kept, the external infection is re-calculated from it at every step (see refreshExternal)
+    std::vector<double> m_beta_dense;
+    static constexpr index s_dense_max = 5000;
+    static constexpr double s_dense_fraction = 0.25;
+    
+    // External infection for each group, from the infective in other groups (m_infective):
+    std::vector<double> m_external;
+    bool m_external_valid = false;
+    
+    // Infective after the last update, so that m_external can be updated from the changes only:
+    // (with a full re-calculation every m_full_interval steps to stop rounding error accumulating)
+    std::vector<double> m_infective_next;
+    bool m_next_valid = false;
+    int m_full_interval = 100;
+    int m_since_full = 0;
+    
+    // Working state for the population-scale next reaction method:
+    std::vector<TransitionSet*> m_transitions;
+    std::vector<std::vector<double>> m_propensity;
+    std::vector<double> m_a0;
+    std::vector<double> m_scale;
+    std::vector<double> m_event_time;
+    IndexedHeap m_heap;
+    long m_n_events = 0;
+    
+    // Persistent worker threads for the group updates (none if single-threaded):
+    std::unique_ptr<ThreadPool> m_pool;
+    
+    // Quiescent groups (see setQuiescence) are left out of the updates, and remember the substep count
+    // at which they were last updated (-1 for active groups);  m_active lists the other groups:
+    bool m_quiescence = false;
+    std::vector<long> m_quiet_since;
+    std::vector<int> m_active;
+    
+    // The deaths of each quiescent group, realised lazily from a generator seeded by setQuiescence,
+    // so that read-only access to a group that is behind gives the state it will later have (see getGroup):
+    // Note: these are mutable as they only cache the part of each path that has been realised so far
+    mutable std::vector<QuiescentPath> m_quiet_path;
+    mutable Philox4x32 m_quiet_rng;
+    mutable Sampler m_quiet_sampler;
+    mutable std::optional<Group> m_projection;
+    
+    // External infection below this is treated as zero (by both the full and the incremental calculations), so
+    // that rounding error left by the incremental updates neither wakes quiescent groups nor stops groups becoming quiescent:
+    static constexpr double s_external_zero = 1e-12;
+    
+    static constexpr double s_infinity = std::numeric_limits<double>::infinity();
     
     MatrixPopulation() = delete;
+    
+    // Re-build (or discard) the dense copy of beta after beta has changed:
+    void updateDense()
+    {
+      index const dd = ssize(m_groups);
+      if (dd > s_dense_max || static_cast<double>(ssize(m_beta_value)) < s_dense_fraction * static_cast<double>(dd*dd)) {
+        m_beta_dense.clear();
+        m_beta_dense.shrink_to_fit();
+        return;
+      }
+      m_beta_dense.assign(dd*dd, 0.0);
+      for (index j=0; j<dd; ++j) {
+        for (int k=m_beta_start[j]; k<m_beta_start[j+1]; ++k) {
+          m_beta_dense[m_beta_target[k]*dd + j] += m_beta_value[k];
+        }
+      }
+    }
+    
+    [[nodiscard]] static constexpr auto clampExternal(double const external) noexcept
+      -> double
+    {
+      return external > s_external_zero ? external : 0.0;
+    }
+    
+    // Force of infection from other groups, in O(nnz) or using the blocked dense kernel:
+    void computeExternal()
+    {
+      m_external.resize(m_groups.size());
+      if (m_beta_dense.empty()) {
+        foiSpmv(m_beta_start, m_beta_target, m_beta_value, m_infective, m_external);
+      } else {
+        foiGemv(m_beta_dense, ssize(m_groups), m_infective, m_external);
+      }
+      for (auto& val : m_external) val = clampExternal(val);
+    }
+    
+    // Bring m_external up to date with the current infective, either by a full re-calculation
+    // in O(nnz) or by applying the changes since the last step in O(nnz of the changed groups):
+    // Note: with a dense copy of beta, the blocked dense kernel does a full re-calculation at
+    // every step, as for dense beta it is faster than scattering the changes by source group
+    void refreshExternal()
+    {
+      if (!m_next_valid) {
+        for (index i=0; i<ssize(m_groups); ++i) {
+          m_infective_next[i] = static_cast<double>(m_groups[i].getInfective());
+        }
+      }
+      m_next_valid = false;
+      
+      if (!m_external_valid || m_since_full >= m_full_interval || !m_beta_dense.empty()) {
+        m_infective = m_infective_next;
+        computeExternal();
+        m_external_valid = true;
+        m_since_full = 0;
+        if (m_quiescence) {
+          for (index i=0; i<ssize(m_groups); ++i) {
+            if (m_quiet_since[i] >= 0 && m_external[i] > 0.0) wake(i);
+          }
+        }
+        return;
+      }
+      
+      for (index j=0; j<ssize(m_groups); ++j) {
+        double const delta = m_infective_next[j] - m_infective[j];
+        if (delta == 0.0) continue;
+        m_infective[j] = m_infective_next[j];
+        for (int k=m_beta_start[j]; k<m_beta_start[j+1]; ++k) {
+          int const ii = m_beta_target[k];
+          // Note: rounding error would otherwise leave a small (possibly negative) value when the infective return to zero
+          m_external[ii] = clampExternal(m_external[ii] + delta * m_beta_value[k]);
+          if (m_quiescence && m_quiet_since[ii] >= 0 && m_external[ii] > 0.0) wake(ii);
+        }
+      }
+      m_since_full++;
+    }
+    
+    // Bring a quiescent group (or a copy of it) up to the current time from its path:
+    void catchUp(Group& target, index const group) const
+    {
+      if constexpr (requires (Group& gp) { gp.advanceQuiescent(1, std::span<double const>()); }) {
+        long const since = m_quiet_since[group];
+        if (since < 0 || since == m_substeps) return;
+        auto const survivors = m_quiet_path[group].survivorsAt(m_substeps - since, m_quiet_rng, m_quiet_sampler);
+        target.advanceQuiescent(static_cast<int>(m_substeps - since), survivors);
+      }
+    }
+    
+    // Return a quiescent group to the active set:
+    void wake(index const group)
+    {
+      if (m_quiet_since[group] < 0) return;
+      catchUp(m_groups[group], group);
+      m_quiet_since[group] = -1;
+      m_active.push_back(static_cast<int>(group));
+    }
+    
+    void wakeAll()
+    {
+      for (index i=0; i<ssize(m_quiet_since); ++i) wake(i);
+    }
+    
+    // Counter-based bridges only: use a separate stream for each group and step, so that
+    // results do not depend on the order (or thread) in which groups are updated:
+    void selectStream(index const group)
+    {
+      if constexpr (requires (Bridge& bridge) { bridge.setStream(0U, 0U); }) {
+        m_bridge.setStream(static_cast<std::uint32_t>(group), static_cast<std::uint32_t>(m_step));
+      }
+    }
+    
+    [[nodiscard]] auto rexp(double const rate)
+      -> double
+    {
+      return -std::log1p(-m_bridge.runif()) / rate;
+    }
+    
+    // Next reaction method over all groups: each group has one putative event time in the heap,
+    // and an event changing the infectives of a group re-scales the times of the groups it infects:
+    void updateExact(int const substeps)
+    {
+      if constexpr (requires (Group& gp) { { gp.beginContinuous() } -> std::same_as<TransitionSet&>; gp.endContinuous(1.0); }) {
+        
+        index const dd = ssize(m_groups);
+        // Events are interleaved between groups, so a single stream is used for the step:
+        selectStream(dd);
+        m_transitions.resize(dd);
+        m_propensity.resize(dd);
+        m_a0.resize(dd);
+        m_scale.resize(dd);
+        m_event_time.resize(dd);
+        
+        for (index i=0; i<dd; ++i) {
+          m_transitions[i] = &m_groups[i].beginContinuous();
+          m_infective[i] = static_cast<double>(m_transitions[i]->infectiveTotal());
+          m_scale[i] = m_groups[i].get_parameters().d_time;
+        }
+        computeExternal();
+        for (index i=0; i<dd; ++i) {
+          m_transitions[i]->setExternalInfection(m_external[i] * m_scale[i]);
+          m_propensity[i].resize(m_transitions[i]->nTransitions());
+          m_a0[i] = m_transitions[i]->propensities(m_propensity[i]);
+          m_event_time[i] = m_a0[i] > 0.0 ? rexp(m_a0[i]) : s_infinity;
+        }
+        m_heap.build(m_event_time);
+        
+        double const duration = static_cast<double>(substeps);
+        while (!m_heap.empty() && m_heap.topKey() < duration) {
+          int const gg = m_heap.top();
+          double const time = m_heap.topKey();
+          TransitionSet& transitions = *m_transitions[gg];
+          
+          // Choose the transition within the group:
+          double const target = m_bridge.runif() * m_a0[gg];
+          double cumulative = 0.0;
+          int jj = -1;
+          for (index k=0; k<ssize(m_propensity[gg]); ++k) {
+            if (m_propensity[gg][k] <= 0.0) continue;
+            cumulative += m_propensity[gg][k];
+            jj = static_cast<int>(k);
+            if (target < cumulative) break;
+          }
+          if (jj < 0) {
+            m_heap.update(gg, s_infinity);
+            continue;
+          }
+          
+          bool const infective = transitions.changesInfective(jj);
+          transitions.fire(jj, 1);
+          m_n_events++;
+          
+          m_a0[gg] = transitions.propensities(m_propensity[gg]);
+          m_heap.update(gg, m_a0[gg] > 0.0 ? time + rexp(m_a0[gg]) : s_infinity);
+          
+          if (!infective) continue;
+          
+          // Update the external infection of dependent groups only:
+          double const now = static_cast<double>(transitions.infectiveTotal());
+          double const delta = now - m_infective[gg];
+          m_infective[gg] = now;
+          for (int k=m_beta_start[gg]; k<m_beta_start[gg+1]; ++k) {
+            int const ii = m_beta_target[k];
+            m_external[ii] = clampExternal(m_external[ii] + delta * m_beta_value[k]);
+            m_transitions[ii]->setExternalInfection(m_external[ii] * m_scale[ii]);
+            
+            double const aold = m_a0[ii];
+            double const anew = m_transitions[ii]->propensities(m_propensity[ii]);
+            m_a0[ii] = anew;
+            
+            double next = s_infinity;
+            if (anew > 0.0) {
+              if (ii != gg && aold > 0.0) {
+                next = time + (aold / anew) * (m_heap.key(ii) - time);
+              } else {
+                next = time + rexp(anew);
+              }
+            }
+            m_heap.update(ii, next);
+          }
+        }
+        
+        for (index i=0; i<dd; ++i) {
+          m_groups[i].set_external_infection(m_external[i]);
+          m_groups[i].endContinuous(duration);
+        }
+        
+      } else {
+        m_bridge.stop("Integrator::Exact is not supported by this group type");
+      }
+    }
 
   public:
     
@@ -59,14 +341,124 @@ namespace blofeld
       setInfective();
     }
     
-    // Set beta matrix:
+    // Set beta from a dense matrix flattened by source group, with beta[j*n+i] from group j to group i
+    // (i.e. the rows of the R matrix, with beta[i,j] from group i to group j, one after another):
+    // Note: only the non-zero values are kept
     void setBetaMatrix(std::vector<double> const& beta)
     {
-      if (beta.size() != std::pow(m_groups.size(), 2)) {
-        m_bridge.println("Incorrect matrix dimensions");
+      index const dd = ssize(m_groups);
+      if (ssize(beta) != dd*dd) {
+        m_bridge.stop("Incorrect matrix dimensions");
+      }
+      if (std::ranges::any_of(beta, [](double const val) { return val < 0.0; })) {
+        m_bridge.stop("Invalid negative entry in beta matrix");
+      }
+      m_beta_start.assign(dd+1, 0);
+      m_beta_target.clear();
+      m_beta_value.clear();
+      for (index j=0; j<dd; ++j) {
+        for (index i=0; i<dd; ++i) {
+          double const val = beta[j*dd+i];
+          if (val != 0.0) {
+            m_beta_target.push_back(static_cast<int>(i));
+            m_beta_value.push_back(val);
+          }
+        }
+        m_beta_start[j+1] = static_cast<int>(ssize(m_beta_target));
+      }
+      updateDense();
+      m_external_valid = false;
+    }
+    
+    // Set beta from compressed sparse columns, i.e. the p, i and x slots of a dgCMatrix with beta[i,j] from
+    // group i to group j (as for the dense R matrix):
+    // Note: the columns are therefore the target groups, so this is transposed to CSR-by-source
+    void setBetaCSC(std::vector<int> const& col_start, std::vector<int> const& row, std::vector<double> const& value)
+    {
+      index const dd = ssize(m_groups);
+      if (ssize(col_start) != dd+1 || col_start.front() != 0 || col_start.back() != ssize(row) || ssize(row) != ssize(value)) {
+        m_bridge.stop("Invalid sparse matrix for {} groups", dd);
+      }
+      std::vector<int> to(row.size());
+      for (index j=0; j<dd; ++j) {
+        if (col_start[j+1] < col_start[j]) m_bridge.stop("Invalid sparse matrix: decreasing column pointers");
+        std::fill(to.begin() + col_start[j], to.begin() + col_start[j+1], static_cast<int>(j));
+      }
+      setBetaEdges(row, to, value);
+    }
+    
+    // Set beta from a dgCMatrix (Matrix package), with beta[i,j] from group i to group j as for the dense R matrix:
+    void setBetaMatrix(Rcpp::S4 const& beta)
+    {
+      if (!beta.is("dgCMatrix")) m_bridge.stop("Sparse beta matrix must be a dgCMatrix");
+      std::vector<int> const dim = Rcpp::as<std::vector<int>>(beta.slot("Dim"));
+      if (ssize(dim) != 2 || dim[0] != ssize(m_groups) || dim[1] != ssize(m_groups)) {
+        m_bridge.stop("Incorrect matrix dimensions");
       }
-      // Take a copy:
-      m_beta = beta;
+      setBetaCSC(Rcpp::as<std::vector<int>>(beta.slot("p")), Rcpp::as<std::vector<int>>(beta.slot("i")), Rcpp::as<std::vector<double>>(beta.slot("x")));
+    }
+    
+    // Set beta from an edge list of (0-based) source and target groups:
+    // Note: repeated edges are allowed, and their beta values are added
+    void setBetaEdges(std::vector<int> const& from, std::vector<int> const& to, std::vector<double> const& beta)
+    {
+      index const dd = ssize(m_groups);
+      if (ssize(from) != ssize(to) || ssize(from) != ssize(beta)) {
+        m_bridge.stop("Edge list vectors must be the same length");
+      }
+      
+      // Counting sort by source:
+      m_beta_start.assign(dd+1, 0);
+      for (index e=0; e<ssize(from); ++e) {
+        if (from[e] < 0 || from[e] >= dd || to[e] < 0 || to[e] >= dd) {
+          m_bridge.stop("Edge {} ({} -> {}) out of range for {} groups", e, from[e], to[e], dd);
+        }
+        if (beta[e] < 0.0) {
+          m_bridge.stop("Invalid negative beta {} for edge {} ({} -> {})", beta[e], e, from[e], to[e]);
+        }
+        m_beta_start[from[e]+1]++;
+      }
+      for (index j=0; j<dd; ++j) {
+        m_beta_start[j+1] += m_beta_start[j];
+      }
+      m_beta_target.resize(from.size());
+      m_beta_value.resize(from.size());
+      std::vector<int> fill(m_beta_start.begin(), m_beta_start.end()-1);
+      for (index e=0; e<ssize(from); ++e) {
+        int const k = fill[from[e]]++;
+        m_beta_target[k] = to[e];
+        m_beta_value[k] = beta[e];
+      }
+      updateDense();
+      m_external_valid = false;
+    }
+    
+    // Force of infection for nrep replicates at once, using this population's beta:
+    // (infective and external are [group][replicate], i.e. each group's replicates are contiguous)
+    void computeExternalBatch(std::span<double const> const infective, index const nrep, std::span<double> const external) const
+    {
+      index const dd = ssize(m_groups);
+      if (ssize(infective) != dd*nrep || ssize(external) != dd*nrep) {
+        m_bridge.stop("Invalid dimensions for computeExternalBatch");
+      }
+      if (m_beta_dense.empty()) {
+        foiSpmm(m_beta_start, m_beta_target, m_beta_value, nrep, infective, external);
+      } else {
+        foiGemm(m_beta_dense, dd, nrep, infective, external);
+      }
+    }
+    
+    [[nodiscard]] auto nGroups() const noexcept
+      -> int
+    {
+      return static_cast<int>(ssize(m_groups));
+    }
+
+    // Number of non-zero beta values:
+    [[nodiscard]] auto nBeta() const noexcept
+      -> int
+    {
+      return static_cast<int>(ssize(m_beta_value));
     }
     
     // Return pointer to a specific group:
@@ -75,16 +467,40 @@ namespace blofeld
       if (num < 0 || num >= ssize(m_groups)) {
         m_bridge.stop("Index {} out of range", num);
       }
+      // The group may be changed, so re-read its infective before the next update:
+      m_next_valid = false;
+      if (m_quiescence) wake(num);
       
       return &(m_groups[num]);
     }
+
+    // Read-only access, which (unlike getGroup) does not invalidate the infective:
+    // Note: a quiescent group that is behind is not changed, so that observing a run does not change it;
+    // instead this points to a copy brought up to date from its path (the state that the group itself
+    // will have when it is woken), which is only valid until the next call
+    Group const* getGroup(int num) const
+    {
+      if (num < 0 || num >= ssize(m_groups)) {
+        m_bridge.stop("Index {} out of range", num);
+      }
+      if (m_quiescence && m_quiet_since[num] >= 0 && m_quiet_since[num] != m_substeps) {
+        m_projection.emplace(m_groups[num]);
+        catchUp(*m_projection, num);
+        return &(*m_projection);
+      }
+      return &(m_groups[num]);
+    }
     
     void setInfective()
     {
-      std::vector<double> vec(std::pow(m_groups.size(), 2), 0.0);
-      setBetaMatrix(vec);
+      // Start with no contacts between groups (without allocating a dense matrix):
+      m_beta_start.assign(m_groups.size()+1, 0);
+      m_beta_target.clear();
+      m_beta_value.clear();
+      updateDense();
       
       m_infective.resize(m_groups.size());
+      m_infective_next.resize(m_groups.size());
       updateInfective();      
     }
     
@@ -93,25 +509,167 @@ namespace blofeld
       for (index i=0; i<ssize(m_groups); ++i) {
         m_infective[i] = static_cast<double>(m_groups[i].getInfective());
       }
+      m_external_valid = false;
+      m_next_valid = false;
+    }
+    
+    // Number of steps between full re-calculations of the external infection (1 means every step):
+    void setRecomputeInterval(int const steps)
+    {
+      if (steps < 1) m_bridge.stop("Invalid recompute interval {}", steps);
+      m_full_interval = steps;
+    }
+    
+    [[nodiscard]] auto getRecomputeInterval() const noexcept
+      -> int
+    {
+      return m_full_interval;
+    }
+    
+    // FixedStep updates each group with its own integrator; Exact uses a next reaction method over all groups:
+    void setIntegrator(Integrator const integrator)
+    {
+      if (integrator == Integrator::TauLeap) {
+        m_bridge.stop("Integrator::TauLeap should be set for the groups (with Integrator::FixedStep for the population)");
+      }
+      m_integrator = integrator;
+    }
+    
+    [[nodiscard]] auto getIntegrator() const noexcept
+      -> Integrator
+    {
+      return m_integrator;
+    }
+    
+    // Number of threads used for the group updates with Integrator::FixedStep (the threads persist between calls):
+    // Note: this requires a thread-safe bridge, and a counter-based RNG gives results that do not depend on n_threads
+    void setThreads(int const n_threads)
+    {
+      if (n_threads < 1) m_bridge.stop("Invalid number of threads {}", n_threads);
+      if constexpr (!requires { requires Bridge::s_thread_safe; }) {
+        if (n_threads > 1) m_bridge.stop("Multi-threading requires a thread-safe bridge (e.g. BridgeParallel)");
+      }
+      if (n_threads == getThreads()) return;
+      m_pool = n_threads > 1 ? std::make_unique<ThreadPool>(n_threads) : nullptr;
+    }
+    
+    [[nodiscard]] auto getThreads() const noexcept
+      -> int
+    {
+      return m_pool ? m_pool->nThreads() : 1;
+    }
+    
+    // Leave groups out of the updates while they are quiescent (nothing but susceptibles, and no external
+    // infection), and bring them up to date from a path of their deaths (see QuiescentPath) when they are
+    // infected or accessed by getGroup() (read-only access gives the same state, and does not change them):
+    // Note: this changes the random numbers used for quiescent groups (but not their distribution)
+    void setQuiescence(bool const quiescence)
+    {
+      if constexpr (!requires (Group const& gp) { { gp.isQuiescent() } -> std::same_as<bool>; }) {
+        if (quiescence) m_bridge.stop("Quiescence is not supported by this group type");
+      } else {
+        if (quiescence == m_quiescence) return;
+        if (!quiescence) {
+          wakeAll();
+          m_quiet_since.clear();
+          m_quiet_path.clear();
+          m_active.clear();
+        } else {
+          m_quiet_since.assign(m_groups.size(), -1);
+          m_quiet_path.resize(m_groups.size());
+          // Note: counter-based bridges draw the seed from a stream that no group uses (so it does not depend on the threads)
+          if constexpr (requires (Bridge& bridge) { bridge.setStream(0U, 0U); }) {
+            m_bridge.setStream(static_cast<std::uint32_t>(m_groups.size()), static_cast<std::uint32_t>(m_step));
+          }
+          m_quiet_rng = Philox4x32(static_cast<std::uint32_t>(m_bridge.runif() * 4294967296.0));
+          m_active.resize(m_groups.size());
+          for (index i=0; i<ssize(m_groups); ++i) m_active[i] = static_cast<int>(i);
+        }
+        m_quiescence = quiescence;
+      }
+    }
+    
+    [[nodiscard]] auto getQuiescence() const noexcept
+      -> bool
+    {
+      return m_quiescence;
+    }
+    
+    // Number of groups currently updated (all groups unless quiescence is enabled):
+    [[nodiscard]] auto nActive() const noexcept
+      -> int
+    {
+      return m_quiescence ? static_cast<int>(ssize(m_active)) : nGroups();
+    }
+    
+    // Number of events from Integrator::Exact:
+    [[nodiscard]] auto nEvents() const noexcept
+      -> long
+    {
+      return m_n_events;
     }
     
     void update_one(int substeps = 1)
     {
-      // First refresh the number of infective:
-      updateInfective();
+      // First refresh the number of infective, and the external infection from it:
+      refreshExternal();
+      if (m_quiescence && m_integrator == Integrator::Exact) wakeAll();
       m_time += static_cast<double>(substeps);
+      m_step++;
+      m_substeps += substeps;
       
-      // And then deal with each group:
-      index const dd = ssize(m_groups);
-      for (index i=0; i<dd; ++i) {
-        // Calculate extbeta:
-        double extb = 0.0;
-        for (index j=0; j<dd; ++j) {
-          extb += m_infective[j] * m_beta[j*dd+i];
-        }        
-        // Set extbeta and update:
-        m_groups[i].set_external_infection(extb);
-        m_groups[i].update(substeps);
+      if (m_integrator == Integrator::Exact) {
+        updateExact(substeps);
+        return;
+      }
+      
+      // And then deal with each (active) group (these are independent, so can be done in parallel):
+      auto const updateGroups = [this, substeps](index const begin, index const end) {
+        for (index k=begin; k<end; ++k) {
+          index const i = m_quiescence ? m_active[k] : k;
+          if constexpr (requires (Bridge& bridge) { bridge.cancelled(); }) {
+            if (m_bridge.cancelled()) return;
+          }
+          // Set extbeta and update:
+          m_groups[i].set_external_infection(m_external[i]);
+          selectStream(i);
+          m_groups[i].update(substeps);
+          m_infective_next[i] = static_cast<double>(m_groups[i].getInfective());
+        }
+      };
+      
+      index const n_update = m_quiescence ? ssize(m_active) : ssize(m_groups);
+      if (!m_pool) {
+        updateGroups(0, n_update);
+      } else if constexpr (requires (Bridge& bridge) { bridge.report(); }) {
+        // Errors from workers are collected by the bridge, and reported here on the main thread:
+        try {
+          m_pool->parallelFor(n_update, updateGroups);
+        } catch (WorkerStopped const&) {
+          // Reported below
+        } catch (...) {
+          // The main thread's chunk stopped (via T_main::stop):  the workers' messages must still be
+          // drained and the channel reset, but the original exception takes precedence
+          try { m_bridge.report(); } catch (...) { }
+          throw;
+        }
+        m_bridge.report();
+      } else {
+        m_pool->parallelFor(n_update, updateGroups);
+      }
+      m_next_valid = true;
+      
+      // Groups that are now quiescent leave the active set (their infective is zero, so m_infective_next stays valid):
+      if constexpr (requires (Group const& gp) { { gp.isQuiescent() } -> std::same_as<bool>; }) {
+        if (m_quiescence) {
+          std::erase_if(m_active, [this](int const i) {
+            if (!m_groups[i].isQuiescent()) return false;
+            m_quiet_since[i] = m_substeps;
+            m_quiet_path[i].start(m_groups[i].getQuiescentS(), m_groups[i].getQuiescentDeath(), std::integral<typename Group::t_Value>,
+                                  static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(m_substeps), m_quiet_rng, m_quiet_sampler);
+            return true;
+          });
+        }
       }
     }
     
@@ -142,7 +700,7 @@ namespace blofeld
       
       bool time_ok = true;
       for (index i=0; i<ssize(m_groups); ++i) {
-        auto const state = m_groups[i].get_state();
+        auto const state = getGroup(static_cast<int>(i))->get_state();
         if (i > 0 && !identical(state.time, rv.Time)) {
           time_ok = false;
         }
@@ -0,0 +1,132 @@
+#ifndef BLOFELD_QUIESCENT_PATH_H
+#define BLOFELD_QUIESCENT_PATH_H
+
+#include <span>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "../utilities/tools.h"
+#include "../utilities/philox.h"
+#include "../utilities/samplers.h"
+
+/*
+  Deaths from S of a quiescent group (see MatrixPopulation::setQuiescence),
+  realised lazily from the step at which the group became quiescent.
+  Each animal dies in each step with probability d, so for a sub-compartment
+  of N animals (with q = 1-d):
+  - the number of steps to the next step with any deaths is geometric, with
+    P(T > t) = q^(N*t)
+  - the first animal to die in that step is K on 1..N, with
+    P(K <= k) = (1-q^k) / (1-q^N)
+  - the deaths in that step are 1 + Bin(N-K, d)
+  which is exactly the distribution of updating every step, but only uses
+  random numbers for the steps in which animals die.
+  Every event has its own stream (keyed by the group, the step at which it
+  became quiescent, and the event), so the survivors at any step are a pure
+  function of the key:  reading the survivors at an intermediate step does
+  not change the survivors that are realised later.
+  Deterministic paths are the expected survivors.
+*/
+
+namespace blofeld
+{
+
+  class QuiescentPath
+  {
+  private:
+    static constexpr long s_never = std::numeric_limits<long>::max();
+
+    bool m_stochastic = false;
+    double m_prop = 0.0;
+    std::uint32_t m_group = 0U;
+    std::uint32_t m_start = 0U;
+
+    // Initial values, and (stochastic only) the survivors after the events realised so far,
+    // the step of the next event, its deaths, and the number of events realised so far:
+    std::vector<double> m_initial;
+    std::vector<double> m_alive;
+    std::vector<long> m_next;
+    std::vector<double> m_deaths;
+    std::vector<std::uint32_t> m_events;
+
+    std::vector<double> m_survivors;
+
+    // Draw the next event for a sub-compartment, from the step of the last event:
+    void drawEvent(index const sub, long const from, Philox4x32& rng, Sampler& sampler)
+    {
+      int const alive = static_cast<int>(m_alive[sub]);
+      if (alive <= 0 || m_prop <= 0.0) {
+        m_next[sub] = s_never;
+        return;
+      }
+
+      index const nsub = ssize(m_alive);
+      rng.setStream(m_group, m_start, m_events[sub] * static_cast<std::uint32_t>(nsub) + static_cast<std::uint32_t>(sub));
+      auto unif = [&rng]() -> double { return rng.uniform(); };
+
+      double const log_q = std::log1p(-m_prop);
+      double const gap = std::floor(std::log(1.0 - unif()) / (static_cast<double>(alive) * log_q)) + 1.0;
+      if (gap >= static_cast<double>(s_never - from)) {
+        m_next[sub] = s_never;
+        return;
+      }
+      m_next[sub] = from + static_cast<long>(gap);
+
+      double const any = -std::expm1(static_cast<double>(alive) * log_q);
+      double const first = std::ceil(std::log1p(-unif() * any) / log_q);
+      int const kk = std::clamp(static_cast<int>(first), 1, alive);
+      m_deaths[sub] = static_cast<double>(1 + sampler.rbinom(unif, alive - kk, m_prop));
+    }
+
+  public:
+    QuiescentPath() = default;
+
+    // Start a path for a group that became quiescent at step start, with the values of each
+    // sub-compartment of S and the proportion that dies per step:
+    void start(std::span<double const> const values, double const prop, bool const stochastic,
+               std::uint32_t const group, std::uint32_t const start, Philox4x32& rng, Sampler& sampler)
+    {
+      m_stochastic = stochastic;
+      m_prop = prop;
+      m_group = group;
+      m_start = start;
+      m_initial.assign(values.begin(), values.end());
+      m_survivors.resize(values.size());
+      if (!m_stochastic) return;
+
+      m_alive = m_initial;
+      m_next.assign(values.size(), s_never);
+      m_deaths.assign(values.size(), 0.0);
+      m_events.assign(values.size(), 0U);
+      for (index j=0; j<ssize(m_alive); ++j) drawEvent(j, 0L, rng, sampler);
+    }
+
+    // The survivors in each sub-compartment after the given number of steps:
+    // Note: the steps must not decrease between calls for stochastic paths
+    [[nodiscard]] auto survivorsAt(long const steps, Philox4x32& rng, Sampler& sampler)
+      -> std::span<double const>
+    {
+      if (!m_stochastic) {
+        double const survival = std::exp(static_cast<double>(steps) * std::log1p(-m_prop));
+        for (index j=0; j<ssize(m_initial); ++j) m_survivors[j] = m_initial[j] * survival;
+        return m_survivors;
+      }
+
+      for (index j=0; j<ssize(m_alive); ++j) {
+        while (m_next[j] <= steps) {
+          m_alive[j] -= m_deaths[j];
+          m_events[j]++;
+          drawEvent(j, m_next[j], rng, sampler);
+        }
+      }
+      std::copy(m_alive.begin(), m_alive.end(), m_survivors.begin());
+      return m_survivors;
+    }
+  };
+
+}
+
+#endif // BLOFELD_QUIESCENT_PATH_H
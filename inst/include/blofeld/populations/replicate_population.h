@@ -0,0 +1,461 @@
+#ifndef REPLICATE_POPULATION_H_
+#define REPLICATE_POPULATION_H_
+
+#include <array>
+#include <vector>
+#include <span>
+#include <cmath>
+#include <cstdint>
+
+#include "../utilities/tools.h"
+#include "../compartmental/compartment_types.h"
+#include "../compartmental/compartment_batch.h"
+#include "../compartmental/seidrvmz_group.h"
+#include "./matrix_population.h"
+
+/*
+  Many stochastic replicates of a MatrixPopulation, simulated in lockstep:
+  every compartment holds all groups and replicates in one CompartmentBatch,
+  with lanes laid out as [group][replicate] (i.e. each group's replicates are
+  contiguous, as for computeExternalBatch).  Anything that does not depend on
+  the state is held once per group rather than once per replicate, and is only
+  re-calculated when the parameters change:
+  - the parameters, and the proportions for every transition with a constant
+    rate (i.e. all except infection), via CompartmentBatch::makePropsShared
+  - beta, which is used directly from the MatrixPopulation (so that population
+    must outlive this object, and changes to its beta are seen here)
+  Each step then draws each transition for all replicates in one batch.
+  The fixed-step update follows SEIDRVMZgroup::update_one exactly, with the
+  external infection from computeExternalBatch.
+*/
+
+namespace blofeld
+{
+
+  // Only implemented for SEIDRVMZgroup (below):
+  template<auto s_cts, class Group>
+  class ReplicatePopulation;
+
+  template <auto s_cts, ModelType s_mtype, CompartmentInfo s_ci_S, CompartmentInfo s_ci_E, CompartmentInfo s_ci_L, CompartmentInfo s_ci_I, CompartmentInfo s_ci_D, CompartmentInfo s_ci_R, CompartmentInfo s_ci_V, CompartmentInfo s_ci_M, CompartmentInfo s_ci_Z>
+  class ReplicatePopulation<s_cts, SEIDRVMZgroup<s_cts, s_mtype, s_ci_S, s_ci_E, s_ci_L, s_ci_I, s_ci_D, s_ci_R, s_ci_V, s_ci_M, s_ci_Z>>
+  {
+  public:
+    using Bridge = decltype(s_cts)::Bridge;
+    using Group = SEIDRVMZgroup<s_cts, s_mtype, s_ci_S, s_ci_E, s_ci_L, s_ci_I, s_ci_D, s_ci_R, s_ci_V, s_ci_M, s_ci_Z>;
+    using Population = MatrixPopulation<s_cts, Group>;
+
+  private:
+    static_assert(s_mtype == ModelType::Stochastic, "ReplicatePopulation is only for stochastic groups");
+
+    static constexpr bool s_have_death = s_ci_Z.is_active();
+    static constexpr bool s_have_vacc = s_ci_V.is_active();
+    static constexpr bool s_have_mort = s_ci_M.is_active();
+
+    // Number of take rates (as for SEIDRVMZgroup):  death first, then vaccine or mortality
+    static constexpr std::size_t s_psd = s_have_death ? 1U : 0U;
+    static constexpr std::size_t s_psv = s_have_vacc ? s_psd+1U : s_psd;
+    static constexpr std::size_t s_psm = s_have_mort ? s_psd+1U : s_psd;
+
+    // One compartment for all lanes, with its rates and proportions (take rates first, then the
+    // carry rate) and the totals taken and carried in the last step:
+    // Note: without carry (i.e. a single sub-compartment) the carry is an extra take, as for process_rate
+    template <CompartmentInfo s_ci, std::size_t s_nrate>
+    struct Stage
+    {
+      static constexpr bool s_extra = s_ci.carry_type == CarryType::None;
+      static constexpr std::size_t s_ntake = s_extra ? s_nrate+1U : s_nrate;
+      static constexpr std::size_t s_ncarry = s_extra ? 0U : 1U;
+
+      CompartmentBatch<s_cts, s_mtype, s_ci> comp;
+      std::array<std::vector<double>, s_nrate+1U> rate;
+      std::array<std::vector<double>, s_nrate+1U> prop;
+      std::array<std::vector<int>, s_nrate+1U> out;
+
+      // Rates are held for nrates groups (shared by replicates) or lanes:
+      Stage(Bridge& bridge, index const nlanes, index const nrates)
+        : comp(bridge, static_cast<int>(nlanes))
+      {
+        if constexpr (s_ci.is_active()) {
+          for (auto& vv : rate) vv.assign(nrates, 0.0);
+          for (auto& vv : prop) vv.assign(nrates, 0.0);
+          for (auto& vv : out) vv.assign(nlanes, 0);
+        }
+      }
+
+      template <typename T, std::size_t s_count, typename V>
+      [[nodiscard]] static auto spans(std::array<std::vector<V>, s_nrate+1U>& vecs, std::size_t const first)
+        -> std::array<std::span<T>, s_count>
+      {
+        std::array<std::span<T>, s_count> rv;
+        for (std::size_t i=0; i<s_count; ++i) rv[i] = std::span<T>(vecs[first+i]);
+        return rv;
+      }
+
+      void makeProps(index const nrep)
+      {
+        comp.makePropsShared(nrep, spans<double const, s_ntake>(rate, 0U), spans<double const, s_ncarry>(rate, s_ntake), spans<double, s_ntake>(prop, 0U), spans<double, s_ncarry>(prop, s_ntake));
+      }
+
+      void takeCarry(index const nrep)
+      {
+        comp.takeCarryPropsShared(nrep, spans<double const, s_ntake>(prop, 0U), spans<double const, s_ncarry>(prop, s_ntake), spans<int, s_ntake>(out, 0U), spans<int, s_ncarry>(out, s_ntake));
+      }
+
+      [[nodiscard]] auto take(std::size_t const tt) const
+        -> std::span<int const>
+      {
+        return out[tt];
+      }
+
+      [[nodiscard]] auto carry() const
+        -> std::span<int const>
+      {
+        return out[s_nrate];
+      }
+    };
+
+    Bridge& m_bridge;
+    Population& m_population;
+
+    index m_ngroups = 0;
+    index m_nrep = 0;
+    index m_nlanes = 0;
+
+    double m_time = 0.0;
+    long m_step = 0;
+
+    // Per group (shared by replicates):
+    std::vector<SEIDRVMZpars> m_pars;
+    std::vector<double> m_beta_subclin;
+    std::vector<double> m_beta_clinical;
+    std::vector<double> m_contact_power;
+    std::vector<double> m_d_time;
+
+    // Per lane, except for the rates/proportions of the constant-rate compartments (per group):
+    Stage<s_ci_S, s_psv> m_S;
+    Stage<s_ci_E, s_psm> m_E;
+    Stage<s_ci_L, s_psm> m_L;
+    Stage<s_ci_I, s_psm> m_I;
+    Stage<s_ci_D, s_psm> m_D;
+    Stage<s_ci_R, s_psv> m_R;
+    Stage<s_ci_V, s_psv> m_V;
+    CompartmentBatch<s_cts, s_mtype, s_ci_M> m_M;
+    std::vector<int> m_Z;
+
+    std::vector<double> m_infective;
+    std::vector<double> m_external;
+    std::vector<int> m_recycle;
+
+    ReplicatePopulation() = delete;
+
+    // Set the constant rates for one group (death first, then vaccine or mortality, then the carry):
+    template <CompartmentInfo s_ci, std::size_t s_nrate>
+    static void setRates(Stage<s_ci, s_nrate>& stage, index const group, double const death, double const other, double const carry)
+    {
+      if constexpr (s_ci.is_active()) {
+        if constexpr (s_have_death) stage.rate[0][group] = death;
+        if constexpr (s_nrate > s_psd) stage.rate[s_psd][group] = other;
+        stage.rate[s_nrate][group] = carry;
+      }
+    }
+
+    // Copy the values of one compartment from a group to all of its replicates:
+    template <typename C, typename B>
+    void setReplicates(B& batch, index const group, C const& compartment)
+    {
+      std::vector<int> const values = compartment.getValuesV();
+      for (index r=0; r<m_nrep; ++r)
+      {
+        batch.setValues(group*m_nrep + r, values);
+      }
+    }
+
+    // Take (per lane) from Z for deaths and insert into another compartment for vaccine/mortality:
+    template <CompartmentInfo s_ci, std::size_t s_nrate, typename B>
+    void takeDeaths(Stage<s_ci, s_nrate> const& stage, B& other)
+    {
+      if constexpr (s_have_death) {
+        std::span<int const> const deaths = stage.take(0U);
+        for (index l=0; l<m_nlanes; ++l) m_Z[l] -= deaths[l];
+      }
+      if constexpr (s_nrate > s_psd) other.insert(stage.take(s_psd));
+    }
+
+    // Process one of E/L/I/D, returning the carry (or the input if the compartment is disabled):
+    template <CompartmentInfo s_ci, std::size_t s_nrate>
+    [[nodiscard]] auto progress(Stage<s_ci, s_nrate>& stage, std::span<int const> const input)
+      -> std::span<int const>
+    {
+      if constexpr (s_ci.is_active()) {
+        stage.comp.insert(input);
+        stage.takeCarry(m_nrep);
+        takeDeaths(stage, m_M);
+        return stage.carry();
+      } else {
+        return input;
+      }
+    }
+
+    [[nodiscard]] auto totals(SEIDRVMZcomp const compartment) const
+      -> std::vector<int>
+    {
+      switch (compartment)
+      {
+        case SEIDRVMZcomp::S: return m_S.comp.getTotals();
+        case SEIDRVMZcomp::E: return m_E.comp.getTotals();
+        case SEIDRVMZcomp::L: return m_L.comp.getTotals();
+        case SEIDRVMZcomp::I: return m_I.comp.getTotals();
+        case SEIDRVMZcomp::D: return m_D.comp.getTotals();
+        case SEIDRVMZcomp::R: return m_R.comp.getTotals();
+        case SEIDRVMZcomp::V: return m_V.comp.getTotals();
+        case SEIDRVMZcomp::M: return m_M.getTotals();
+      }
+      m_bridge.stop("Unrecognised compartment value in getTotals");
+      return { };
+    }
+
+  public:
+
+    // Start nrep replicates from the current state of each group in the population:
+    explicit ReplicatePopulation(Bridge& bridge, Population& population, int const nrep)
+      : m_bridge(bridge), m_population(population),
+        m_ngroups(population.nGroups()), m_nrep(nrep), m_nlanes(population.nGroups() * static_cast<index>(nrep)),
+        m_S(bridge, m_nlanes, m_nlanes), m_E(bridge, m_nlanes, m_ngroups), m_L(bridge, m_nlanes, m_ngroups),
+        m_I(bridge, m_nlanes, m_ngroups), m_D(bridge, m_nlanes, m_ngroups), m_R(bridge, m_nlanes, m_ngroups),
+        m_V(bridge, m_nlanes, m_ngroups), m_M(bridge, static_cast<int>(m_nlanes))
+    {
+      if (nrep < 1) m_bridge.stop("Invalid number of replicates {}", nrep);
+
+      m_Z.assign(m_nlanes, 0);
+      m_infective.assign(m_nlanes, 0.0);
+      m_external.assign(m_nlanes, 0.0);
+      m_recycle.assign(m_nlanes, 0);
+
+      for (index i=0; i<m_ngroups; ++i)
+      {
+        Group const& group = *m_population.getGroup(static_cast<int>(i));
+        auto const state = group.get_state();
+        setReplicates(m_S.comp, i, state.S);
+        setReplicates(m_E.comp, i, state.E);
+        setReplicates(m_L.comp, i, state.L);
+        setReplicates(m_I.comp, i, state.I);
+        setReplicates(m_D.comp, i, state.D);
+        setReplicates(m_R.comp, i, state.R);
+        setReplicates(m_V.comp, i, state.V);
+        setReplicates(m_M, i, state.M);
+
+        // Z is re-calculated as for SEIDRVMZgroup::set_state:
+        int const total = state.S.getTotal() + state.E.getTotal() + state.L.getTotal() + state.I.getTotal() + state.D.getTotal() + state.R.getTotal() + state.V.getTotal() + state.M.getTotal();
+        std::fill(m_Z.begin() + i*m_nrep, m_Z.begin() + (i+1)*m_nrep, total);
+        m_time = state.time;
+      }
+
+      refreshParameters();
+    }
+
+    // Re-read the parameters of each group from the population, and re-calculate the shared proportions:
+    void refreshParameters()
+    {
+      m_pars.resize(m_ngroups);
+      m_beta_subclin.resize(m_ngroups);
+      m_beta_clinical.resize(m_ngroups);
+      m_contact_power.resize(m_ngroups);
+      m_d_time.resize(m_ngroups);
+
+      for (index i=0; i<m_ngroups; ++i)
+      {
+        SEIDRVMZpars const pars = m_population.getGroup(static_cast<int>(i))->get_parameters();
+        m_pars[i] = pars;
+
+        // As for SEIDRVMZgroup::set_parameters (the contact power is not adjusted by d_time):
+        m_beta_subclin[i] = pars.beta_subclin * pars.d_time;
+        m_beta_clinical[i] = pars.beta_clinical * pars.d_time;
+        m_contact_power[i] = pars.contact_power;
+        m_d_time[i] = pars.d_time;
+
+        double const death = pars.death * pars.d_time;
+        double const vaccination = pars.vaccination * pars.d_time;
+        setRates(m_E, i, death, pars.mortality_E * pars.d_time, pars.incubation * pars.d_time);
+        setRates(m_L, i, death, pars.mortality_L * pars.d_time, pars.progression * pars.d_time);
+        setRates(m_I, i, death, pars.mortality_I * pars.d_time, pars.recovery * pars.d_time);
+        setRates(m_D, i, death, pars.mortality_D * pars.d_time, pars.healing * pars.d_time);
+        setRates(m_R, i, death, vaccination, pars.reversion * pars.d_time);
+        setRates(m_V, i, death, vaccination, pars.waning * pars.d_time);
+
+        // S has a per-lane infection rate, so its (constant) death and vaccination rates are also per lane:
+        for (index l=i*m_nrep; l<(i+1)*m_nrep; ++l)
+        {
+          setRates(m_S, l, death, vaccination, 0.0);
+        }
+      }
+
+      if constexpr (s_ci_E.is_active()) m_E.makeProps(m_nrep);
+      if constexpr (s_ci_L.is_active()) m_L.makeProps(m_nrep);
+      if constexpr (s_ci_I.is_active()) m_I.makeProps(m_nrep);
+      if constexpr (s_ci_D.is_active()) m_D.makeProps(m_nrep);
+      if constexpr (s_ci_R.is_active()) m_R.makeProps(m_nrep);
+      if constexpr (s_ci_V.is_active()) m_V.makeProps(m_nrep);
+    }
+
+    [[nodiscard]] auto nGroups() const noexcept
+      -> int
+    {
+      return static_cast<int>(m_ngroups);
+    }
+
+    [[nodiscard]] auto nReplicates() const noexcept
+      -> int
+    {
+      return static_cast<int>(m_nrep);
+    }
+
+    [[nodiscard]] auto getTime() const noexcept
+      -> double
+    {
+      return m_time;
+    }
+
+    void update_one()
+    {
+      m_time += 1.0;
+      m_step++;
+
+      // Counter-based bridges only: a single stream for each step, as draws are batched over all lanes
+      if constexpr (requires (Bridge& bridge) { bridge.setStream(0U, 0U); }) {
+        m_bridge.setStream(0U, static_cast<std::uint32_t>(m_step));
+      }
+
+      // Infection rates for every lane, from the within-group and (batched) external infection:
+      std::vector<int> const nL = m_L.comp.getTotals();
+      std::vector<int> const nI = m_I.comp.getTotals();
+      std::vector<int> const nD = m_D.comp.getTotals();
+      std::vector<int> const nM = m_M.getTotals();
+      for (index l=0; l<m_nlanes; ++l)
+      {
+        m_infective[l] = static_cast<double>(s_ci_D.is_active() ? nI[l] + nD[l] : nI[l]);
+      }
+      m_population.computeExternalBatch(m_infective, m_nrep, m_external);
+
+      std::vector<double>& inf_rate = m_S.rate[s_psv];
+      for (index i=0; i<m_ngroups; ++i)
+      {
+        for (index l=i*m_nrep; l<(i+1)*m_nrep; ++l)
+        {
+          int const alive = m_Z[l] - (s_have_mort ? nM[l] : 0);
+          if (alive <= 0) {
+            // Everything is empty, so there is nothing to do:
+            inf_rate[l] = 0.0;
+            continue;
+          }
+          double const freqdens = std::pow(static_cast<double>(alive), m_contact_power[i]);
+          double const nLl = s_ci_L.is_active() ? static_cast<double>(nL[l]) : 0.0;
+          double const nIl = s_ci_I.is_active() ? static_cast<double>(nI[l]) : 0.0;
+          inf_rate[l] = m_external[l] * m_d_time[i] + ((m_beta_subclin[i] * nLl + m_beta_clinical[i] * nIl) / freqdens);
+        }
+      }
+      m_S.makeProps(1);
+
+      // We always have S:
+      m_S.takeCarry(1);
+      takeDeaths(m_S, m_V.comp);
+
+      auto const E_carry = progress(m_E, m_S.carry());
+      auto const L_carry = progress(m_L, E_carry);
+      auto const I_carry = progress(m_I, L_carry);
+      auto const D_carry = progress(m_D, I_carry);
+
+      // Note: deliberately restart R (and V) rather than go to V for vaccine effect:
+      auto const R_carry = [&](){
+        if constexpr (s_ci_R.is_active()) {
+          m_R.comp.insert(D_carry);
+          m_R.takeCarry(m_nrep);
+          takeDeaths(m_R, m_R.comp);
+          return m_R.carry();
+        } else {
+          return D_carry;
+        }
+      }();
+
+      std::copy(R_carry.begin(), R_carry.end(), m_recycle.begin());
+      if constexpr (s_ci_V.is_active()) {
+        m_V.takeCarry(m_nrep);
+        takeDeaths(m_V, m_V.comp);
+        std::span<int const> const V_carry = m_V.carry();
+        for (index l=0; l<m_nlanes; ++l) m_recycle[l] += V_carry[l];
+      }
+      m_S.comp.insert(m_recycle);
+
+      m_S.comp.applyChanges();
+      if constexpr (s_ci_E.is_active()) m_E.comp.applyChanges();
+      if constexpr (s_ci_L.is_active()) m_L.comp.applyChanges();
+      if constexpr (s_ci_I.is_active()) m_I.comp.applyChanges();
+      if constexpr (s_ci_D.is_active()) m_D.comp.applyChanges();
+      if constexpr (s_ci_R.is_active()) m_R.comp.applyChanges();
+      if constexpr (s_ci_V.is_active()) m_V.comp.applyChanges();
+      if constexpr (s_ci_M.is_active()) m_M.applyChanges();
+    }
+
+    void update(int const steps)
+    {
+      for (int i=0; i<steps; ++i) {
+        update_one();
+        Rcpp::checkUserInterrupt();
+      }
+    }
+
+    // Totals of a compartment for every group and replicate, as [group][replicate]:
+    [[nodiscard]] auto getTotals(SEIDRVMZcomp const compartment) const
+      -> std::vector<int>
+    {
+      return totals(compartment);
+    }
+
+    // Totals over groups for one replicate (as for MatrixPopulation::getState):
+    auto getState(int const replicate) const
+    {
+      if (replicate < 0 || replicate >= m_nrep) {
+        m_bridge.stop("Replicate {} out of range", replicate);
+      }
+
+      struct
+      {
+        double Time = 0.0;
+        double S = 0.0;
+        double E = 0.0;
+        double L = 0.0;
+        double I = 0.0;
+        double D = 0.0;
+        double R = 0.0;
+        double V = 0.0;
+        double M = 0.0;
+      } rv;
+
+      rv.Time = m_time;
+      auto const sum = [&](SEIDRVMZcomp const compartment) -> double {
+        std::vector<int> const tots = totals(compartment);
+        double total = 0.0;
+        for (index i=0; i<m_ngroups; ++i) total += static_cast<double>(tots[i*m_nrep + replicate]);
+        return total;
+      };
+      rv.S = sum(SEIDRVMZcomp::S);
+      rv.E = sum(SEIDRVMZcomp::E);
+      rv.L = sum(SEIDRVMZcomp::L);
+      rv.I = sum(SEIDRVMZcomp::I);
+      rv.D = sum(SEIDRVMZcomp::D);
+      rv.R = sum(SEIDRVMZcomp::R);
+      rv.V = sum(SEIDRVMZcomp::V);
+      rv.M = sum(SEIDRVMZcomp::M);
+
+      return rv;
+    }
+
+    void show()
+    {
+      m_bridge.println("ReplicatePopulation of {} groups with {} replicates", m_ngroups, m_nrep);
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // REPLICATE_POPULATION_H_
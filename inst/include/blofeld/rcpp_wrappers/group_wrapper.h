@@ -4,8 +4,11 @@
 // We MUST have Rcpp access here, as this is a wrapper to Rcpp
 #include <Rcpp.h>
 
+#include <memory>
 #include <type_traits>
 
+#include "./trajectory_wrapper.h"
+
 namespace blofeld
 {
   
@@ -24,6 +27,38 @@ namespace blofeld
   };
   */
 
+  // Either owns a group, or points to one that is owned elsewhere (e.g. inside a MatrixPopulation):
+  template <class Tgroup>
+  class PtrWrap
+  {
+  public:
+
+    bool owner = true;
+    // Note: for now must be shared (not unique) ptr as copies need to be made
+    std::shared_ptr<Tgroup> shared;
+    Tgroup* raw = nullptr;
+
+    Tgroup& operator* () const
+    {
+      return *getPtr();
+    }
+
+    Tgroup* operator-> () const
+    {
+      return getPtr();
+    }
+
+    Tgroup* getPtr() const
+    {
+      if (owner) {
+        return shared.get();
+      } else {
+        return raw;
+      }
+    }
+
+  };
+
   template <auto s_cts, class Tgroup>
   class GroupWrapper //: public BasicGroup
   {
@@ -37,13 +72,33 @@ namespace blofeld
     using List = Rcpp::List;
     using DataFrame = Rcpp::DataFrame;
 
-    // For now this has ownership - modify in future to e.g. shared pointer?
-    std::unique_ptr<Tgroup> m_group;
+    PtrWrap<Tgroup> m_group;
 
   public:
     GroupWrapper()
     {
-      m_group = std::make_unique<Tgroup>(m_bridge);
+      m_group.shared = std::make_shared<Tgroup>(m_bridge);
+      m_group.owner = true;
+    }
+
+    explicit GroupWrapper(Tgroup* ptr)
+    {
+      // For now we assume that ptr will be valid while this class is valid:
+      m_group.raw = ptr;
+      m_group.owner = false;
+    }
+
+    // Point to a group owned elsewhere (used by MatrixPopulationWrapper after taking ownership):
+    void changePtr(Tgroup* ptr)
+    {
+      m_group.shared.reset();
+      m_group.raw = ptr;
+      m_group.owner = false;
+    }
+
+    Tgroup* getPtr()
+    {
+      return m_group.getPtr();
     }
 
     /*
@@ -65,6 +120,15 @@ namespace blofeld
       return rv;
     }
     
+    // Run for a number of steps, recording the named compartment totals every interval steps:
+    auto run(int const n_steps, Rcpp::StringVector const compartments, int const interval)
+      -> DataFrame
+    {
+      TrajectoryRecorder<Bridge, typename Tgroup::t_Value> recorder(m_bridge, compartmentsFromNames(m_bridge, compartments), interval);
+      recorder.run(*m_group, n_steps);
+      return trajectoryDataFrame(recorder, false);
+    }
+
     void set_external_infection(double const extinf)
     {
       m_group -> set_external_infection(extinf);
@@ -4,20 +4,23 @@
 // We MUST have Rcpp access here, as this is a wrapper to Rcpp
 #include <Rcpp.h>
 
+#include <string>
 #include <type_traits>
 
 #include "../populations/matrix_population.h"
+#include "./group_wrapper.h"
+#include "./trajectory_wrapper.h"
 
 namespace blofeld
 {
 
-  template <class MPop>
+  template <auto s_cts, class Group>
   class MatrixPopulationWrapper
   {
   private:
+    using MPop = MatrixPopulation<s_cts, Group>;
     using Bridge = MPop::Bridge;
-    using Group = MPop::GroupType;
-    using GpWp = GroupWrapper<Group>;
+    using GpWp = GroupWrapper<s_cts, Group>;
 
     Bridge m_bridge;
 
@@ -60,10 +63,42 @@ namespace blofeld
 
     Rcpp::DataFrame update(int const steps)
     {
+      // Note: the groups may have been changed from R (via the group wrappers) since the last update
+      m_pop->updateInfective();
       m_pop->update(steps);
       return getState();
     }
     
+    // Run for a number of steps, recording the named compartment totals (per group or in total) every interval steps:
+    Rcpp::DataFrame run(int const steps, Rcpp::StringVector const compartments, int const interval, bool const by_group)
+    {
+      TrajectoryRecorder<Bridge, typename Group::t_Value> recorder(m_bridge, compartmentsFromNames(m_bridge, compartments), interval, by_group);
+      m_pop->updateInfective();
+      recorder.run(*m_pop, steps);
+      return trajectoryDataFrame(recorder, by_group);
+    }
+
+    // Run for a number of steps, recording only the changes in the named compartment totals of each group:
+    Rcpp::DataFrame runEvents(int const steps, Rcpp::StringVector const compartments)
+    {
+      EventLog<Bridge, typename Group::t_Value> log(m_bridge, compartmentsFromNames(m_bridge, compartments), m_pop->nGroups());
+      m_pop->updateInfective();
+      log.run(*m_pop, steps);
+      return eventLogDataFrame(log);
+    }
+
+    // Run for a number of steps, writing the named compartment totals of every group to a trajectory file
+    // every interval steps, and returning the number of records written:
+    // Note: the file is overwritten, and can be read with TrajectoryReaderWrapper
+    int runStore(int const steps, std::string const path, Rcpp::StringVector const compartments, int const interval)
+    {
+      TrajectoryStore<Bridge, typename Group::t_Value> store(m_bridge, path, compartmentsFromNames(m_bridge, compartments), m_pop->nGroups(), interval);
+      m_pop->updateInfective();
+      store.run(*m_pop, steps);
+      store.close();
+      return static_cast<int>(store.nRecords());
+    }
+    
     Rcpp::DataFrame getState() const
     {
       auto const state = m_pop->getState();
@@ -105,6 +140,12 @@ namespace blofeld
       m_pop->setBetaMatrix(vec);
     }
 
+    // Sparse equivalent of setBetaMatrix, from a Matrix::dgCMatrix:
+    void setBetaSparse(Rcpp::S4 beta)
+    {
+      m_pop->setBetaMatrix(beta);
+    }
+
     /*
 
 
@@ -5,6 +5,7 @@
   class_<NAME>(#NAME) \
     .constructor() \
     .method("update", &NAME::update) \
+    .method("run", &NAME::run) \
     .method("get_parameters", &NAME::get_parameters) \
     .method("set_parameters", &NAME::set_parameters) \
     .method("get_full_state", &NAME::get_full_state) \
@@ -0,0 +1,198 @@
+#ifndef BLOFELD_TRAJECTORY_WRAPPER_H
+#define BLOFELD_TRAJECTORY_WRAPPER_H
+
+// We MUST have Rcpp access here, as this is a wrapper to Rcpp
+#include <Rcpp.h>
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+#include "../output/trajectory_recorder.h"
+#include "../output/trajectory_store.h"
+#include "../output/event_log.h"
+
+namespace blofeld
+{
+
+  // Compartments from their names (e.g. c("S","I","R") from R):
+  template <class Bridge>
+  [[nodiscard]] auto compartmentsFromNames(Bridge& bridge, Rcpp::StringVector const& names)
+    -> std::vector<SEIDRVMZcomp>
+  {
+    std::vector<SEIDRVMZcomp> rv;
+    for (int i=0; i<names.size(); ++i)
+    {
+      std::string const nm = Rcpp::as<std::string>(names[i]);
+      bool found = false;
+      for (auto const comp : { SEIDRVMZcomp::S, SEIDRVMZcomp::E, SEIDRVMZcomp::L, SEIDRVMZcomp::I, SEIDRVMZcomp::D, SEIDRVMZcomp::R, SEIDRVMZcomp::V, SEIDRVMZcomp::M })
+      {
+        if (nm == compartmentName(comp)) {
+          rv.push_back(comp);
+          found = true;
+        }
+      }
+      if (!found) bridge.stop("Unrecognised compartment name '{}'", nm);
+    }
+    return rv;
+  }
+
+  // Everything recorded, as a single data frame (each column is copied once):
+  template <class Recorder>
+  [[nodiscard]] auto trajectoryDataFrame(Recorder const& recorder, bool const group_column)
+    -> Rcpp::DataFrame
+  {
+    using namespace Rcpp;
+    using trcpp = std::conditional_t<std::is_same<typename Recorder::Value, int>::value, IntegerVector, NumericVector>;
+
+    auto const times = recorder.getTimes();
+    List rv = List::create(_["Time"] = NumericVector(times.begin(), times.end()));
+    if (group_column) {
+      // Note: 1-based for R
+      auto const groups = recorder.getGroups();
+      IntegerVector gp(groups.begin(), groups.end());
+      for (int i=0; i<gp.size(); ++i) gp[i] += 1;
+      rv.push_back(gp, "Group");
+    }
+    auto const compartments = recorder.getCompartments();
+    for (index k=0; k<ssize(compartments); ++k)
+    {
+      auto const values = recorder.getValues(k);
+      rv.push_back(trcpp(values.begin(), values.end()), std::string(compartmentName(compartments[k])));
+    }
+
+    return DataFrame(rv);
+  }
+
+  // An event log as a data frame of (Time, Group, Compartment, Delta), starting with the non-zero initial
+  // values as deltas from zero (so the state at any time is the cumulative sum of Delta by group and compartment):
+  template <class Bridge, typename Value>
+  [[nodiscard]] auto eventLogDataFrame(EventLog<Bridge, Value> const& log)
+    -> Rcpp::DataFrame
+  {
+    using namespace Rcpp;
+    using trcpp = std::conditional_t<std::is_same<Value, int>::value, IntegerVector, NumericVector>;
+
+    auto const compartments = log.getCompartments();
+    index const ncomp = ssize(compartments);
+    auto const initial = log.getInitial();
+    index ninit = 0;
+    for (auto const val : initial) if (val != static_cast<Value>(0)) ++ninit;
+
+    index const nrow = ninit + log.nEvents();
+    NumericVector time(nrow);
+    IntegerVector group(nrow);
+    StringVector compartment(nrow);
+    trcpp delta(nrow);
+
+    // Note: 1-based groups for R
+    index rr = 0;
+    for (index i=0; i<ssize(initial); ++i)
+    {
+      if (initial[i] == static_cast<Value>(0)) continue;
+      time[rr] = log.getInitialTime();
+      group[rr] = static_cast<int>(i / ncomp) + 1;
+      compartment[rr] = std::string(compartmentName(compartments[i % ncomp]));
+      delta[rr] = initial[i];
+      ++rr;
+    }
+    for (index ev=0; ev<log.nEvents(); ++ev, ++rr)
+    {
+      time[rr] = log.getTimes()[ev];
+      group[rr] = log.getGroups()[ev] + 1;
+      compartment[rr] = std::string(compartmentName(compartments[log.getEventCompartments()[ev]]));
+      delta[rr] = log.getDeltas()[ev];
+    }
+
+    return DataFrame::create(_["Time"] = time, _["Group"] = group, _["Compartment"] = compartment, _["Delta"] = delta);
+  }
+
+  // Slice of a trajectory file for the given (1-based) groups and records with from <= time <= to, as a data frame:
+  // Note: only the records in the time window are read from the file
+  template <class Bridge>
+  [[nodiscard]] auto trajectorySlice(TrajectoryReader<Bridge> const& reader, Rcpp::IntegerVector const& groups, double const from, double const to)
+    -> Rcpp::DataFrame
+  {
+    using namespace Rcpp;
+
+    std::vector<int> gps(groups.begin(), groups.end());
+    for (auto& gg : gps) gg -= 1;
+
+    index const first = reader.findRecord(from);
+    index last = first;
+    while (last < reader.nRecords() && reader.getTime(last) <= to) ++last;
+    std::vector<double> const values = reader.readSlice(gps, first, last-first);
+
+    index const ngp = ssize(gps);
+    index const ncomp = ssize(reader.getCompartments());
+    index const nrow = (last-first) * ngp;
+    NumericVector time(nrow);
+    IntegerVector group(nrow);
+    for (index r=0; r<last-first; ++r)
+    {
+      double const tt = reader.getTime(first + r);
+      for (index g=0; g<ngp; ++g)
+      {
+        time[r*ngp + g] = tt;
+        group[r*ngp + g] = gps[g] + 1;
+      }
+    }
+
+    List rv = List::create(_["Time"] = time, _["Group"] = group);
+    for (index k=0; k<ncomp; ++k)
+    {
+      NumericVector column(nrow);
+      for (index i=0; i<nrow; ++i) column[i] = values[i*ncomp + k];
+      std::string const name(compartmentName(reader.getCompartments()[k]));
+      if (reader.isInteger()) {
+        rv.push_back(as<IntegerVector>(column), name);
+      } else {
+        rv.push_back(column, name);
+      }
+    }
+
+    return DataFrame(rv);
+  }
+
+  // Holds a trajectory file open (mapped) from R, so that repeated slices only read what they need:
+  template <class Bridge>
+  class TrajectoryReaderWrapper
+  {
+  private:
+    Bridge m_bridge;
+    std::unique_ptr<TrajectoryReader<Bridge>> m_reader;
+
+  public:
+    explicit TrajectoryReaderWrapper(std::string const path)
+    {
+      m_reader = std::make_unique<TrajectoryReader<Bridge>>(m_bridge, path);
+    }
+
+    Rcpp::DataFrame slice(Rcpp::IntegerVector const groups, double const from, double const to)
+    {
+      return trajectorySlice(*m_reader, groups, from, to);
+    }
+
+    [[nodiscard]] auto nRecords() const
+      -> int
+    {
+      return static_cast<int>(m_reader->nRecords());
+    }
+
+    [[nodiscard]] auto nGroups() const
+      -> int
+    {
+      return m_reader->nGroups();
+    }
+
+    void show()
+    {
+      m_bridge.println("Trajectory file with {} groups and {} records", m_reader->nGroups(), m_reader->nRecords());
+    }
+
+  };
+
+} // blofeld
+
+#endif // BLOFELD_TRAJECTORY_WRAPPER_H
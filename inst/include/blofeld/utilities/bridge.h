@@ -6,6 +6,7 @@
 #include <type_traits>
 
 #include "../utilities/tools.h"
+#include "./samplers.h"
 
 namespace blofeld
 {
@@ -17,6 +18,9 @@ namespace blofeld
   {
   protected:
     
+    // Native binomial/multinomial samplers, driven by the derived class's uniform source:
+    Sampler m_sampler;
+    
     // This is just a base class:
     Bridge()
     {
@@ -57,7 +61,7 @@ namespace blofeld
         R rv{};
         int sum = 0;
         double pp = 1.0;
-        for (index i = 0; i < (ssize(prob)-1); ++i)
+        for (index i = 0; i < (ssize(prob)-1) && sum < n; ++i)
         {
           int const tt = rbinom(n-sum, prob[i] / pp);
           rv[i] = tt;
@@ -82,7 +86,7 @@ namespace blofeld
         rv.resize(s_size);
         int sum = 0;
         double pp = 1.0;
-        for (index i = 0; i < (ssize(prob)-1); ++i)
+        for (index i = 0; i < (ssize(prob)-1) && sum < n; ++i)
         {
           int const tt = rbinom(n-sum, prob[i] / pp);
           rv[i] = tt;
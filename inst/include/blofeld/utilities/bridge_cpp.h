@@ -5,8 +5,12 @@
 #include <format>
 #include <iostream>
 #include <stdexcept>
+#include <span>
+#include <cstdint>
+#include <array>
 
 #include "./bridge.h"
+#include "./philox.h"
 
 namespace blofeld
 {
@@ -18,6 +22,21 @@ namespace blofeld
     // https://en.cppreference.com/w/cpp/numeric/random.html
     T_rng m_rng;
 
+    // Buffer of uniforms used by the batched draws:
+    static constexpr int s_buffer_size = 256;
+    std::array<double, s_buffer_size> m_uniform { };
+    int m_uniform_used = s_buffer_size;
+
+    auto nextUniform()
+      -> double
+    {
+      if (m_uniform_used == s_buffer_size) {
+        runif_batch(m_uniform);
+        m_uniform_used = 0;
+      }
+      return m_uniform[m_uniform_used++];
+    }
+
   public:
     // Generic constructor with no default for unknown RNG type
     explicit BridgeCpp(T_rng rng)
@@ -37,6 +56,22 @@ namespace blofeld
     {
     }
 
+    // Counter-based engines only: select the stream for subsequent draws
+    // (so results are independent of the order in which groups are updated)
+    void setStream(std::uint32_t const group, std::uint32_t const step, std::uint32_t const transition = 0U)
+      requires(requires (T_rng& rng) { rng.setStream(group, step, transition); })
+    {
+      m_rng.setStream(group, step, transition);
+      m_uniform_used = s_buffer_size;
+    }
+
+    void setReplicate(std::uint32_t const replicate)
+      requires(requires (T_rng& rng) { rng.setReplicate(replicate); })
+    {
+      m_rng.setReplicate(replicate);
+      m_uniform_used = s_buffer_size;
+    }
+
     template<typename... Args>
     void print(std::format_string<Args...>&& fmt, Args&&... args)
     {
@@ -70,14 +105,59 @@ namespace blofeld
       std::cout << "WARNING: " << msg << "\n";
     }
 
+    auto runif()
+      -> double
+    {
+      return std::uniform_real_distribution<double>(0.0, 1.0)(m_rng);
+    }
+
+    // Fill a buffer of uniforms, using the engine's own bulk generation where available:
+    auto runif_batch(std::span<double> const out)
+      -> void
+    {
+      if constexpr (requires (T_rng& rng) { rng.fillUniform(out); }) {
+        m_rng.fillUniform(out);
+      } else {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        for (auto& val : out) val = dist(m_rng);
+      }
+    }
+
+    // Uses the native sampler rather than constructing a std::binomial_distribution for every draw:
     auto rbinom(int const n, double const p)
       -> int
     {
       // TODO: check n and p
 
       if(n==0) return(0);
-      std::binomial_distribution<> d(n, p);
-      return d(m_rng);
+      auto unif = [this]() -> double { return runif(); };
+      return m_sampler.rbinom(unif, n, p);
+    }
+
+    auto rpois(double const lambda)
+      -> int
+    {
+      auto unif = [this]() -> double { return runif(); };
+      return Sampler::rpois(unif, lambda);
+    }
+
+    // Binomial draws for n.size() == p.size() == out.size() (using buffered uniforms):
+    auto rbinom_batch(std::span<int const> const n, std::span<double const> const p, std::span<int> const out)
+      -> void
+    {
+      auto unif = [this]() -> double { return nextUniform(); };
+      for (index i=0; i<ssize(out); ++i)
+      {
+        out[i] = n[i]==0 ? 0 : m_sampler.rbinom(unif, n[i], p[i]);
+      }
+    }
+
+    // Equal-probability multinomial, writing into out:
+    auto rmultinomEqual(int const total, std::span<int> const out)
+      -> void
+    {
+      auto unif = [this]() -> double { return runif(); };
+      m_sampler.rmultinomEqual(unif, total, out);
     }
     
     // Works with array or vector input rates (maybe also Rcpp::NumericVector ??):
@@ -95,6 +175,7 @@ namespace blofeld
   };
 
   using BridgeMT19937 = BridgeCpp<std::mt19937>;
+  using BridgePhilox = BridgeCpp<Philox4x32>;
 
 } //blofeld
 
@@ -0,0 +1,243 @@
+#ifndef BLOFELD_BRIDGE_PARALLEL_H
+#define BLOFELD_BRIDGE_PARALLEL_H
+
+#include <array>
+#include <span>
+#include <format>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <atomic>
+
+#include "./bridge.h"
+#include "./philox.h"
+#include "./bridge_worker.h"
+
+/*
+  A bridge that can be shared by every thread of a parallel loop (e.g. groups
+  held by a multi-threaded MatrixPopulation):
+  - random numbers come from a Philox4x32 engine (and Sampler) held per thread,
+    keyed by this bridge's seed and replicate, and selected with setStream;  so
+    as long as each unit of work selects its own stream, results are identical
+    regardless of the number of threads or which thread does the work
+  - print/warning/stop are forwarded to the main-thread bridge (T_main, e.g.
+    BridgeRcpp) when called on the main thread, and posted to a BridgeChannel
+    from any other thread;  report() is then called by the main thread after the
+    parallel region, and cancelled() allows the other workers to stop early
+*/
+
+namespace blofeld
+{
+
+  template<class T_main>
+  class BridgeParallel : protected Bridge
+  {
+  private:
+    T_main& m_main;
+    std::thread::id const m_main_id;
+    BridgeChannel m_channel;
+
+    std::uint32_t m_seed = 0U;
+    std::uint32_t m_replicate = 0U;
+
+    // Unique identifier for the current seed and replicate (so thread states from elsewhere are re-keyed):
+    static inline std::atomic<std::uint64_t> s_next_id { 1U };
+    std::uint64_t m_id = s_next_id.fetch_add(1U);
+
+    // Random number state for the current thread:
+    static constexpr int s_buffer_size = 256;
+    struct ThreadState
+    {
+      std::uint64_t id = 0U;
+      Philox4x32 rng { };
+      Sampler sampler { };
+      std::array<double, s_buffer_size> uniform { };
+      int used = s_buffer_size;
+    };
+    static inline thread_local ThreadState t_state { };
+
+    // The thread's state, re-keyed if it was last used by another bridge (or replicate):
+    [[nodiscard]] auto state()
+      -> ThreadState&
+    {
+      if (t_state.id != m_id) {
+        t_state.id = m_id;
+        t_state.rng = Philox4x32(m_seed, m_replicate);
+        t_state.used = s_buffer_size;
+      }
+      return t_state;
+    }
+
+    [[nodiscard]] auto onMain() const noexcept
+      -> bool
+    {
+      return std::this_thread::get_id() == m_main_id;
+    }
+
+  public:
+    // Can be used from multiple threads at once:
+    static constexpr bool s_thread_safe = true;
+
+    explicit BridgeParallel(T_main& main, std::uint32_t const seed = 0U, std::uint32_t const replicate = 0U)
+      : m_main(main), m_main_id(std::this_thread::get_id()), m_seed(seed), m_replicate(replicate)
+    {
+    }
+
+    BridgeParallel(BridgeParallel const&) = delete;
+    BridgeParallel& operator=(BridgeParallel const&) = delete;
+
+    // Select the stream (for the calling thread) for subsequent draws:
+    void setStream(std::uint32_t const group, std::uint32_t const step, std::uint32_t const transition = 0U)
+    {
+      ThreadState& ts = state();
+      ts.rng.setStream(group, step, transition);
+      ts.used = s_buffer_size;
+    }
+
+    // Main thread only (i.e. not within a parallel region):
+    void setReplicate(std::uint32_t const replicate)
+    {
+      m_replicate = replicate;
+      m_id = s_next_id.fetch_add(1U);
+    }
+
+
+    /* Output and errors */
+
+    template<typename... Args>
+    void print(std::format_string<Args...> const fmt, Args&&... args)
+    {
+      std::string msg = std::vformat(fmt.get(), std::make_format_args(args...));
+      if (onMain()) {
+        m_main.print("{}", msg);
+      } else {
+        m_channel.post(BridgeChannel::MessageType::Print, std::move(msg));
+      }
+    }
+
+    template<typename... Args>
+    void println(std::format_string<Args...> const fmt, Args&&... args)
+    {
+      std::string msg = std::vformat(fmt.get(), std::make_format_args(args...));
+      if (onMain()) {
+        m_main.println("{}", msg);
+      } else {
+        m_channel.post(BridgeChannel::MessageType::Print, std::move(msg) + "\n");
+      }
+    }
+
+    void println()
+    {
+      if (onMain()) {
+        m_main.println();
+      } else {
+        m_channel.post(BridgeChannel::MessageType::Print, "\n");
+      }
+    }
+
+    template<typename... Args>
+    void stop(std::format_string<Args...> const fmt, Args&&... args)
+    {
+      std::string msg = std::vformat(fmt.get(), std::make_format_args(args...));
+      if (onMain()) {
+        m_main.stop("{}", msg);
+      } else {
+        m_channel.post(BridgeChannel::MessageType::Error, msg);
+      }
+      // In case T_main::stop returns:
+      throw WorkerStopped(msg);
+    }
+
+    template<typename... Args>
+    void warning(std::format_string<Args...> const fmt, Args&&... args)
+    {
+      std::string msg = std::vformat(fmt.get(), std::make_format_args(args...));
+      if (onMain()) {
+        m_main.warning("{}", msg);
+      } else {
+        m_channel.post(BridgeChannel::MessageType::Warning, std::move(msg));
+      }
+    }
+
+    [[nodiscard]] auto cancelled() const noexcept
+      -> bool
+    {
+      return m_channel.cancelled();
+    }
+
+    // Main thread only:  replay anything posted by the workers (stopping if there were errors)
+    void report()
+    {
+      m_channel.report(m_main);
+    }
+
+
+    /* Random numbers */
+
+    auto runif()
+      -> double
+    {
+      return state().rng.uniform();
+    }
+
+    auto runif_batch(std::span<double> const out)
+      -> void
+    {
+      state().rng.fillUniform(out);
+    }
+
+    auto rbinom(int const n, double const p)
+      -> int
+    {
+      if (n==0) return 0;
+      ThreadState& ts = state();
+      auto unif = [&ts]() -> double { return ts.rng.uniform(); };
+      return ts.sampler.rbinom(unif, n, p);
+    }
+
+    auto rbinom_batch(std::span<int const> const n, std::span<double const> const p, std::span<int> const out)
+      -> void
+    {
+      ThreadState& ts = state();
+      auto unif = [&ts]() -> double {
+        if (ts.used == s_buffer_size) {
+          ts.rng.fillUniform(ts.uniform);
+          ts.used = 0;
+        }
+        return ts.uniform[ts.used++];
+      };
+      for (index i=0; i<ssize(out); ++i)
+      {
+        out[i] = n[i]==0 ? 0 : ts.sampler.rbinom(unif, n[i], p[i]);
+      }
+    }
+
+    auto rpois(double const lambda)
+      -> int
+    {
+      ThreadState& ts = state();
+      auto unif = [&ts]() -> double { return ts.rng.uniform(); };
+      return Sampler::rpois(unif, lambda);
+    }
+
+    auto rmultinomEqual(int const total, std::span<int> const out)
+      -> void
+    {
+      ThreadState& ts = state();
+      auto unif = [&ts]() -> double { return ts.rng.uniform(); };
+      ts.sampler.rmultinomEqual(unif, total, out);
+    }
+
+    template <Container C>
+    [[nodiscard]] auto rmultinom(int const total, C const& prob) noexcept(!Resizeable<C>)
+      -> std::conditional_t<Resizeable<C>, std::vector<int>, std::array<int, C{}.size()>>
+    {
+      auto fun = [this](int n, double p) -> int { return rbinom(n,p); };
+      return Bridge::rmultinom(fun, total, prob);
+    }
+
+  };
+
+} //blofeld
+
+#endif // BLOFELD_BRIDGE_PARALLEL_H
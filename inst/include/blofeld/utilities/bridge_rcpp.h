@@ -3,11 +3,15 @@
 
 #include <format>
 #include <iostream>
+#include <span>
+#include <cstdint>
+#include <cmath>
 
 #include <Rcpp.h>
 #define R_NO_REMAP
 
 #include "./bridge.h"
+#include "./philox.h"
 
 namespace blofeld
 {
@@ -15,11 +19,60 @@ namespace blofeld
   class BridgeRcpp : protected Bridge
   {
   private:
+    // Use the native sampler (driven by R's unif_rand) rather than R::rbinom:
+    bool m_native_sampler = false;
+
+    // Use a native engine (seeded once from R, or from a given seed) rather than R's RNG:
+    // (no R API calls are then made for random numbers, and the native sampler is always used)
+    bool m_native_rng = false;
+    Philox4x32 m_native { };
 
   public:
-    explicit BridgeRcpp()
+    explicit BridgeRcpp(bool const native_sampler = false)
+      : m_native_sampler(native_sampler)
+    {
+
+    }
+
+    // Seed the native engine from R's RNG, so that results follow set.seed():
+    // R's state (.Random.seed) is advanced and written back before returning
+    void useNativeRng()
+    {
+      Rcpp::RNGScope scope;
+      auto const seed = static_cast<std::uint32_t>(std::floor(R::unif_rand() * 4294967296.0));
+      auto const replicate = static_cast<std::uint32_t>(std::floor(R::unif_rand() * 4294967296.0));
+      m_native = Philox4x32(seed, replicate);
+      m_native_rng = true;
+    }
+
+    // Seed the native engine from a user seed, without using (or changing) R's RNG:
+    void useNativeRng(std::uint32_t const seed)
+    {
+      m_native = Philox4x32(seed);
+      m_native_rng = true;
+    }
+
+    // Revert to drawing every random number from R:
+    void useRRng() noexcept
     {
+      m_native_rng = false;
+    }
 
+    [[nodiscard]] auto nativeRng() const noexcept
+      -> bool
+    {
+      return m_native_rng;
+    }
+
+    // Streams for the native engine (ignored when using R's RNG):
+    void setStream(std::uint32_t const group, std::uint32_t const step, std::uint32_t const transition = 0U)
+    {
+      if (m_native_rng) m_native.setStream(group, step, transition);
+    }
+
+    void setReplicate(std::uint32_t const replicate)
+    {
+      if (m_native_rng) m_native.setReplicate(replicate);
     }
 
     template<typename... Args>
@@ -56,13 +109,77 @@ namespace blofeld
       Rcpp::warning(msg);
     }
 
+    auto runif()
+      -> double
+    {
+      if (m_native_rng) return m_native.uniform();
+      return R::unif_rand();
+    }
+
     auto rbinom(int const n, double const p)
       -> int
     {
+      // Note: empty sub-compartments are common, and R::rbinom is comparatively expensive even for n==0
+      if (n==0) return 0;
+      if (m_native_sampler || m_native_rng) {
+        auto unif = [this]() -> double { return runif(); };
+        return m_sampler.rbinom(unif, n, p);
+      }
       int const rv = R::rbinom(n, p);
       return rv;
     }
 
+    // Note: R's RNG state is shared, so unless using the native engine this is a loop over the scalar draws
+    auto runif_batch(std::span<double> const out)
+      -> void
+    {
+      if (m_native_rng) {
+        m_native.fillUniform(out);
+      } else {
+        for (auto& val : out) val = R::unif_rand();
+      }
+    }
+
+    // Binomial draws for n.size() == p.size() == out.size():
+    auto rbinom_batch(std::span<int const> const n, std::span<double const> const p, std::span<int> const out)
+      -> void
+    {
+      for (index i=0; i<ssize(out); ++i)
+      {
+        out[i] = n[i]==0 ? 0 : rbinom(n[i], p[i]);
+      }
+    }
+
+    auto rpois(double const lambda)
+      -> int
+    {
+      auto unif = [this]() -> double { return runif(); };
+      return Sampler::rpois(unif, lambda);
+    }
+
+    // Equal-probability multinomial, writing into out:
+    // Note: unless using the native sampler, these are conditional binomials from R::rbinom (as for rmultinom)
+    auto rmultinomEqual(int const total, std::span<int> const out)
+      -> void
+    {
+      if (m_native_sampler || m_native_rng) {
+        auto unif = [this]() -> double { return runif(); };
+        m_sampler.rmultinomEqual(unif, total, out);
+        return;
+      }
+      if (out.empty()) return;
+      double const prob = 1.0 / static_cast<double>(ssize(out));
+      int sum = 0;
+      double pp = 1.0;
+      for (index i=0; i<(ssize(out)-1); ++i)
+      {
+        out[i] = rbinom(total-sum, prob / pp);
+        pp -= prob;
+        sum += out[i];
+      }
+      out.back() = total-sum;
+    }
+
     // Works with array or vector input rates (maybe also Rcpp::NumericVector ??):
     template <Container C>
     [[nodiscard]] auto rmultinom(int const total, C const& prob) noexcept(!Resizeable<C>)
@@ -0,0 +1,212 @@
+#ifndef BLOFELD_BRIDGE_WORKER_H
+#define BLOFELD_BRIDGE_WORKER_H
+
+#include <atomic>
+#include <format>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+
+#include "./bridge_cpp.h"
+
+/*
+  Bridges for use off the main (R) thread:
+  - BridgeChannel is shared between all workers and the main thread:  it holds
+    a lock-free (multi-producer) queue of printed output, warnings and errors,
+    and a cancellation token that is set by the first error
+  - BridgeWorker<T_rng> is a BridgeCpp with its own engine (one per worker),
+    where print/warning/stop post to the channel rather than calling R or
+    writing to std::cout;  stop() also throws WorkerStopped to unwind the worker
+  After the parallel region the main thread calls channel.report(bridge) to
+  replay everything through its own bridge (so Rcpp::stop etc are only ever
+  called from the main thread).
+*/
+
+namespace blofeld
+{
+
+  // Thrown by BridgeWorker::stop (and checkCancelled) to unwind a worker:
+  class WorkerStopped : public std::runtime_error
+  {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  class BridgeChannel
+  {
+  public:
+    enum class MessageType
+    {
+      Print,
+      Warning,
+      Error
+    };
+
+  private:
+    struct Node
+    {
+      MessageType type;
+      std::string text;
+      Node* next = nullptr;
+    };
+
+    std::atomic<Node*> m_head { nullptr };
+    std::atomic<bool> m_cancelled { false };
+
+    // Take everything posted so far, in the order it was posted:
+    [[nodiscard]] auto drain()
+      -> std::vector<std::pair<MessageType, std::string>>
+    {
+      Node* node = m_head.exchange(nullptr, std::memory_order_acquire);
+      std::vector<std::pair<MessageType, std::string>> rv;
+      for (; node; )
+      {
+        rv.emplace_back(node->type, std::move(node->text));
+        Node* const next = node->next;
+        delete node;
+        node = next;
+      }
+      std::reverse(rv.begin(), rv.end());
+      return rv;
+    }
+
+  public:
+    BridgeChannel() = default;
+    BridgeChannel(BridgeChannel const&) = delete;
+    BridgeChannel& operator=(BridgeChannel const&) = delete;
+
+    ~BridgeChannel()
+    {
+      static_cast<void>(drain());
+    }
+
+    // Safe to call from any thread:
+    void post(MessageType const type, std::string text)
+    {
+      Node* const node = new Node { .type = type, .text = std::move(text), .next = nullptr };
+      node->next = m_head.load(std::memory_order_relaxed);
+      while (!m_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+      {
+      }
+      if (type == MessageType::Error) cancel();
+    }
+
+    void cancel() noexcept
+    {
+      m_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto cancelled() const noexcept
+      -> bool
+    {
+      return m_cancelled.load(std::memory_order_relaxed);
+    }
+
+    // Run a worker task, catching anything thrown so that it is reported (not propagated) from the thread:
+    template <typename F>
+    void run(F&& task) noexcept
+    {
+      try {
+        std::forward<F>(task)();
+      } catch (WorkerStopped const&) {
+        // Already posted
+      } catch (std::exception const& e) {
+        post(MessageType::Error, e.what());
+      } catch (...) {
+        post(MessageType::Error, "Unknown exception in worker thread");
+      }
+    }
+
+    // Main thread only:  replay output and warnings, then stop with the first error (if any)
+    // Note: the cancellation token is reset so that the channel can be re-used
+    template <class B>
+    void report(B& bridge)
+    {
+      std::string error;
+      int nerrors = 0;
+      for (auto& [type, text] : drain())
+      {
+        if (type == MessageType::Print) {
+          bridge.print("{}", text);
+        } else if (type == MessageType::Warning) {
+          bridge.warning("{}", text);
+        } else {
+          if (nerrors == 0) error = std::move(text);
+          nerrors++;
+        }
+      }
+      m_cancelled.store(false, std::memory_order_relaxed);
+
+      if (nerrors == 1) {
+        bridge.stop("{}", error);
+      } else if (nerrors > 1) {
+        bridge.stop("{} (and {} further errors in worker threads)", error, nerrors-1);
+      }
+    }
+
+  };
+
+  template<typename T_rng>
+  class BridgeWorker : public BridgeCpp<T_rng>
+  {
+  private:
+    BridgeChannel& m_channel;
+
+  public:
+    explicit BridgeWorker(BridgeChannel& channel, T_rng rng)
+      : BridgeCpp<T_rng>(std::move(rng)), m_channel(channel)
+    {
+    }
+
+    template<typename... Args>
+    void print(std::format_string<Args...> const fmt, Args&&... args)
+    {
+      m_channel.post(BridgeChannel::MessageType::Print, std::vformat(fmt.get(), std::make_format_args(args...)));
+    }
+
+    template<typename... Args>
+    void println(std::format_string<Args...> const fmt, Args&&... args)
+    {
+      m_channel.post(BridgeChannel::MessageType::Print, std::vformat(fmt.get(), std::make_format_args(args...)) + "\n");
+    }
+
+    void println()
+    {
+      m_channel.post(BridgeChannel::MessageType::Print, "\n");
+    }
+
+    template<typename... Args>
+    void stop(std::format_string<Args...> const fmt, Args&&... args)
+    {
+      std::string msg = std::vformat(fmt.get(), std::make_format_args(args...));
+      m_channel.post(BridgeChannel::MessageType::Error, msg);
+      throw WorkerStopped(msg);
+    }
+
+    template<typename... Args>
+    void warning(std::format_string<Args...> const fmt, Args&&... args)
+    {
+      m_channel.post(BridgeChannel::MessageType::Warning, std::vformat(fmt.get(), std::make_format_args(args...)));
+    }
+
+    // Cooperative cancellation, for workers to call between units of work:
+    [[nodiscard]] auto cancelled() const noexcept
+      -> bool
+    {
+      return m_channel.cancelled();
+    }
+
+    void checkCancelled()
+    {
+      if (m_channel.cancelled()) throw WorkerStopped("Cancelled");
+    }
+
+  };
+
+  using BridgeWorkerPhilox = BridgeWorker<Philox4x32>;
+
+} //blofeld
+
+#endif // BLOFELD_BRIDGE_WORKER_H
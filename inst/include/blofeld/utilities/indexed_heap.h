@@ -0,0 +1,132 @@
+#ifndef BLOFELD_INDEXED_HEAP_H
+#define BLOFELD_INDEXED_HEAP_H
+
+#include <vector>
+#include <span>
+#include <utility>
+
+#include "../utilities/tools.h"
+
+/*
+  Indexed binary min-heap over a fixed set of ids 0..n-1, each with a double
+  key (e.g. putative event times for the next reaction method).  Every id is
+  always in the heap, and changing a key is O(log n) via the position index.
+*/
+
+namespace blofeld
+{
+
+  class IndexedHeap
+  {
+  private:
+    std::vector<double> m_key;    // Key by id
+    std::vector<int> m_heap;      // Id by heap position
+    std::vector<int> m_pos;       // Heap position by id
+
+    auto swapNodes(int const a, int const b) noexcept
+      -> void
+    {
+      std::swap(m_heap[a], m_heap[b]);
+      m_pos[m_heap[a]] = a;
+      m_pos[m_heap[b]] = b;
+    }
+
+    auto siftUp(int pos) noexcept
+      -> void
+    {
+      while (pos > 0)
+      {
+        int const parent = (pos - 1) / 2;
+        if (m_key[m_heap[parent]] <= m_key[m_heap[pos]]) break;
+        swapNodes(pos, parent);
+        pos = parent;
+      }
+    }
+
+    auto siftDown(int pos) noexcept
+      -> void
+    {
+      int const n = static_cast<int>(ssize(m_heap));
+      while (true)
+      {
+        int const left = 2 * pos + 1;
+        if (left >= n) break;
+        int const right = left + 1;
+        int smallest = (right < n && m_key[m_heap[right]] < m_key[m_heap[left]]) ? right : left;
+        if (m_key[m_heap[pos]] <= m_key[m_heap[smallest]]) break;
+        swapNodes(pos, smallest);
+        pos = smallest;
+      }
+    }
+
+  public:
+    IndexedHeap() = default;
+
+    // Re-build from a full set of keys in O(n):
+    auto build(std::span<double const> const keys)
+      -> void
+    {
+      int const n = static_cast<int>(ssize(keys));
+      m_key.assign(keys.begin(), keys.end());
+      m_heap.resize(n);
+      m_pos.resize(n);
+      for (int i=0; i<n; ++i)
+      {
+        m_heap[i] = i;
+        m_pos[i] = i;
+      }
+      for (int i=n/2-1; i>=0; --i)
+      {
+        siftDown(i);
+      }
+    }
+
+    [[nodiscard]] auto size() const noexcept
+      -> int
+    {
+      return static_cast<int>(ssize(m_heap));
+    }
+
+    [[nodiscard]] auto empty() const noexcept
+      -> bool
+    {
+      return m_heap.empty();
+    }
+
+    // Id with the smallest key:
+    [[nodiscard]] auto top() const
+      -> int
+    {
+      return m_heap.front();
+    }
+
+    [[nodiscard]] auto topKey() const
+      -> double
+    {
+      return m_key[m_heap.front()];
+    }
+
+    [[nodiscard]] auto key(int const id) const
+      -> double
+    {
+      return m_key[id];
+    }
+
+    // Change the key for an id:
+    auto update(int const id, double const key) noexcept
+      -> void
+    {
+      double const old = m_key[id];
+      m_key[id] = key;
+      if (key < old) {
+        siftUp(m_pos[id]);
+      } else if (key > old) {
+        siftDown(m_pos[id]);
+      }
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_INDEXED_HEAP_H
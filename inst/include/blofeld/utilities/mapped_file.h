@@ -0,0 +1,190 @@
+#ifndef BLOFELD_MAPPED_FILE_H
+#define BLOFELD_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*
+  A file mapped into memory (POSIX only for now):  read-only for readers, so
+  that only the pages actually accessed are loaded, or read-write for writers,
+  where resize() extends (or truncates) the file and re-maps it.  Space is
+  allocated on disk when the file is extended, so that a full disk is reported
+  by resize() rather than by a signal on a later write.
+  Methods return false on failure, with the reason from error(), so that the
+  caller can report it through its bridge.
+*/
+
+namespace blofeld
+{
+
+  class MappedFile
+  {
+  private:
+    int m_fd = -1;
+    std::byte* m_data = nullptr;
+    std::size_t m_size = 0U;
+    bool m_writable = false;
+    std::string m_error;
+
+    auto fail(std::string const& what)
+      -> bool
+    {
+      m_error = what + ": " + std::strerror(errno);
+      return false;
+    }
+
+    void unmap() noexcept
+    {
+#if !defined(_WIN32)
+      if (m_data) munmap(m_data, m_size);
+#endif
+      m_data = nullptr;
+    }
+
+    // Extend the file to the given size, with disk space allocated for all of it:
+    auto allocate(std::size_t const size)
+      -> bool
+    {
+#if defined(__APPLE__)
+      fstore_t store { F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size - m_size), 0 };
+      if (fcntl(m_fd, F_PREALLOCATE, &store) == -1) return fail("Unable to reserve space for file");
+      if (ftruncate(m_fd, static_cast<off_t>(size)) != 0) return fail("Unable to resize file");
+#elif !defined(_WIN32)
+      // Note: posix_fallocate returns the error rather than setting errno
+      int const err = posix_fallocate(m_fd, static_cast<off_t>(m_size), static_cast<off_t>(size - m_size));
+      if (err != 0) {
+        errno = err;
+        return fail("Unable to reserve space for file");
+      }
+#else
+      static_cast<void>(size);
+#endif
+      return true;
+    }
+
+    auto map()
+      -> bool
+    {
+#if !defined(_WIN32)
+      if (m_size == 0U) return true;
+      int const prot = m_writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+      void* const ptr = mmap(nullptr, m_size, prot, MAP_SHARED, m_fd, 0);
+      if (ptr == MAP_FAILED) return fail("Unable to map file");
+      m_data = static_cast<std::byte*>(ptr);
+      return true;
+#else
+      return false;
+#endif
+    }
+
+  public:
+    MappedFile() = default;
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    ~MappedFile()
+    {
+      close();
+    }
+
+    // Open an existing file (read-only), or create/overwrite one (read-write, initially empty):
+    auto open(std::string const& path, bool const writable)
+      -> bool
+    {
+      close();
+#if !defined(_WIN32)
+      m_writable = writable;
+      m_fd = writable ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_RDONLY);
+      if (m_fd < 0) return fail("Unable to open '" + path + "'");
+      struct stat st;
+      if (fstat(m_fd, &st) != 0) return fail("Unable to stat '" + path + "'");
+      m_size = static_cast<std::size_t>(st.st_size);
+      return map();
+#else
+      static_cast<void>(path);
+      static_cast<void>(writable);
+      m_error = "Memory-mapped files are not yet supported on Windows";
+      return false;
+#endif
+    }
+
+    // Change the size of a writable file (the contents up to the smaller size are kept):
+    auto resize(std::size_t const size)
+      -> bool
+    {
+#if !defined(_WIN32)
+      if (!m_writable) {
+        m_error = "Unable to resize a read-only file";
+        return false;
+      }
+      unmap();
+      if (size > m_size) {
+        // Note: the blocks must be allocated now, as running out of disk space
+        // while writing through a shared mapping raises SIGBUS instead of an error
+        if (!allocate(size)) return false;
+      } else if (ftruncate(m_fd, static_cast<off_t>(size)) != 0) {
+        return fail("Unable to resize file");
+      }
+      m_size = size;
+      return map();
+#else
+      static_cast<void>(size);
+      return false;
+#endif
+    }
+
+    void close() noexcept
+    {
+      unmap();
+#if !defined(_WIN32)
+      if (m_fd >= 0) ::close(m_fd);
+#endif
+      m_fd = -1;
+      m_size = 0U;
+    }
+
+    [[nodiscard]] auto isOpen() const noexcept
+      -> bool
+    {
+      return m_fd >= 0;
+    }
+
+    [[nodiscard]] auto data() noexcept
+      -> std::byte*
+    {
+      return m_data;
+    }
+
+    [[nodiscard]] auto data() const noexcept
+      -> std::byte const*
+    {
+      return m_data;
+    }
+
+    [[nodiscard]] auto size() const noexcept
+      -> std::size_t
+    {
+      return m_size;
+    }
+
+    [[nodiscard]] auto error() const noexcept
+      -> std::string const&
+    {
+      return m_error;
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_MAPPED_FILE_H
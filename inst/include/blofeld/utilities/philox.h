@@ -0,0 +1,168 @@
+#ifndef BLOFELD_PHILOX_H
+#define BLOFELD_PHILOX_H
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+/*
+  Counter-based random number engine (Philox4x32-10; Salmon et al., 2011)
+  Each block of 4 outputs is a pure function of a 128-bit counter and a
+  64-bit key, so there is no sequential state to share between threads.
+  The key is (seed, replicate) and the counter is (draw, transition, step,
+  group), so every (replicate, group, step, transition) has its own stream
+  and results do not depend on the order in which groups are updated.
+  Note: repeating a run with the same seed and replicate gives identical
+  results once setStream is used, so replicates should call setReplicate.
+
+  This satisfies std::uniform_random_bit_generator, so it can be used with
+  BridgeCpp (see BridgePhilox in bridge_cpp.h).
+*/
+
+namespace blofeld
+{
+
+  class Philox4x32
+  {
+  public:
+    using result_type = std::uint32_t;
+
+  private:
+    using Block = std::array<std::uint32_t, 4>;
+
+    static constexpr std::uint32_t s_mult_0 = 0xD2511F53U;
+    static constexpr std::uint32_t s_mult_1 = 0xCD9E8D57U;
+    static constexpr std::uint32_t s_weyl_0 = 0x9E3779B9U;
+    static constexpr std::uint32_t s_weyl_1 = 0xBB67AE85U;
+    static constexpr int s_rounds = 10;
+
+    std::array<std::uint32_t, 2> m_key { };
+    Block m_counter { };
+    Block m_output { };
+    int m_used = 4;
+
+    // Two 32-bit words to a uniform on [0,1) at 53-bit resolution:
+    [[nodiscard]] static constexpr auto toUniform(std::uint32_t const hi, std::uint32_t const lo) noexcept
+      -> double
+    {
+      return static_cast<double>(((static_cast<std::uint64_t>(hi) << 32) | lo) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    [[nodiscard]] static constexpr auto mulhilo(std::uint32_t const a, std::uint32_t const b, std::uint32_t& hi) noexcept
+      -> std::uint32_t
+    {
+      std::uint64_t const product = static_cast<std::uint64_t>(a) * static_cast<std::uint64_t>(b);
+      hi = static_cast<std::uint32_t>(product >> 32);
+      return static_cast<std::uint32_t>(product);
+    }
+
+  public:
+    // Apply the bijection to a counter and key (exposed for testing against known answers):
+    [[nodiscard]] static constexpr auto generate(Block counter, std::array<std::uint32_t, 2> key) noexcept
+      -> Block
+    {
+      for (int r=0; r<s_rounds; ++r)
+      {
+        std::uint32_t hi0 = 0U;
+        std::uint32_t hi1 = 0U;
+        std::uint32_t const lo0 = mulhilo(s_mult_0, counter[0], hi0);
+        std::uint32_t const lo1 = mulhilo(s_mult_1, counter[2], hi1);
+        counter = { hi1 ^ counter[1] ^ key[0], lo1, hi0 ^ counter[3] ^ key[1], lo0 };
+        key[0] += s_weyl_0;
+        key[1] += s_weyl_1;
+      }
+      return counter;
+    }
+
+    explicit constexpr Philox4x32(std::uint32_t const seed = 0U, std::uint32_t const replicate = 0U) noexcept
+      : m_key { seed, replicate }
+    {
+    }
+
+    // Select the stream for a replicate (keeping the seed), and reset to its start:
+    constexpr auto setReplicate(std::uint32_t const replicate) noexcept
+      -> void
+    {
+      m_key[1] = replicate;
+      setStream(m_counter[3], m_counter[2], m_counter[1]);
+    }
+
+    // Select the stream for a group, time step and (optionally) transition, and reset to its start:
+    constexpr auto setStream(std::uint32_t const group, std::uint32_t const step, std::uint32_t const transition = 0U) noexcept
+      -> void
+    {
+      m_counter = { 0U, transition, step, group };
+      m_used = 4;
+    }
+
+    static constexpr auto min() noexcept
+      -> result_type
+    {
+      return std::numeric_limits<result_type>::min();
+    }
+
+    static constexpr auto max() noexcept
+      -> result_type
+    {
+      return std::numeric_limits<result_type>::max();
+    }
+
+    constexpr auto operator()() noexcept
+      -> result_type
+    {
+      if (m_used == 4) {
+        // Note: 2^32 blocks per stream before the draw counter wraps
+        m_output = generate(m_counter, m_key);
+        m_counter[0]++;
+        m_used = 0;
+      }
+      return m_output[m_used++];
+    }
+
+    // A single uniform on [0,1) from the next two outputs:
+    constexpr auto uniform() noexcept
+      -> double
+    {
+      std::uint32_t const hi = (*this)();
+      return toUniform(hi, (*this)());
+    }
+
+    // Fill with uniforms on [0,1) at 53-bit resolution, two per block (starting from a fresh block):
+    // Note: the blocks are independent, so this loop is free of dependencies between iterations
+    constexpr auto fillUniform(std::span<double> const out) noexcept
+      -> void
+    {
+      std::size_t const nblocks = (out.size() + 1U) / 2U;
+      for (std::size_t b=0; b<nblocks; ++b)
+      {
+        Block counter = m_counter;
+        counter[0] += static_cast<std::uint32_t>(b);
+        Block const block = generate(counter, m_key);
+        out[2U*b] = toUniform(block[0], block[1]);
+        if (2U*b + 1U < out.size()) out[2U*b + 1U] = toUniform(block[2], block[3]);
+      }
+      m_counter[0] += static_cast<std::uint32_t>(nblocks);
+      m_used = 4;
+    }
+
+    // Skip ahead without generating the intermediate blocks:
+    constexpr auto discard(unsigned long long n) noexcept
+      -> void
+    {
+      auto const remaining = static_cast<unsigned long long>(4 - m_used);
+      if (n <= remaining) {
+        m_used += static_cast<int>(n);
+        return;
+      }
+      n -= remaining;
+      m_counter[0] += static_cast<std::uint32_t>(n / 4U);
+      m_used = 4;
+      for (n %= 4U; n > 0U; --n) static_cast<void>((*this)());
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_PHILOX_H
@@ -0,0 +1,328 @@
+#ifndef BLOFELD_SAMPLERS_H
+#define BLOFELD_SAMPLERS_H
+
+#include <cmath>
+#include <span>
+#include <limits>
+#include <algorithm>
+
+#include "../utilities/tools.h"
+
+/*
+  Native binomial/multinomial samplers that can be plugged into any Bridge
+  The samplers are generic over the source of uniform random numbers, which
+  is any callable returning a double on [0,1) - so the same algorithms can be
+  driven by R's unif_rand(), a std:: engine, or a counter-based generator.
+
+  Methods used for rbinom (with p replaced by 1-p when p>0.5):
+  - n*p < s_inversion_np:   sequential search inversion (BINV)
+  - p < s_poisson_p:        Poisson inversion (total variation error < p)
+  - otherwise:              BTPE (Kachitvichyanukul & Schmeiser, 1988)
+
+  Methods used for rpois:
+  - lambda < s_ptrs_lambda: sequential search inversion
+  - otherwise:              PTRS (Hormann, 1993)
+*/
+
+namespace blofeld
+{
+
+  template<typename T>
+  concept UniformSource = requires(T x)
+  {
+    { x() } -> std::convertible_to<double>;
+  };
+
+  class Sampler
+  {
+  private:
+    static constexpr double s_inversion_np = 30.0;
+    static constexpr double s_poisson_p = 1e-10;
+    static constexpr double s_ptrs_lambda = 10.0;
+
+    // Setup for BTPE, re-used while n and p are unchanged (e.g. repeated draws for one sub-compartment):
+    struct BtpeSetup
+    {
+      int n = -1;
+      double p = -1.0;
+      double r = 0.0;
+      double q = 0.0;
+      double fm = 0.0;
+      int m = 0;
+      double p1 = 0.0;
+      double xm = 0.0;
+      double xl = 0.0;
+      double xr = 0.0;
+      double c = 0.0;
+      double laml = 0.0;
+      double lamr = 0.0;
+      double p2 = 0.0;
+      double p3 = 0.0;
+      double p4 = 0.0;
+    };
+    BtpeSetup m_btpe;
+
+    // Sequential search inversion, for n*p small (p <= 0.5):
+    template <UniformSource U>
+    [[nodiscard]] static auto binomialInversion(U& unif, int const n, double const p)
+      -> int
+    {
+      double const q = 1.0 - p;
+      double const qn = std::exp(static_cast<double>(n) * std::log1p(-p));
+      double const np = static_cast<double>(n) * p;
+      int const bound = static_cast<int>(std::min(static_cast<double>(n), np + 10.0 * std::sqrt(np * q + 1.0)));
+
+      int x = 0;
+      double px = qn;
+      double u = unif();
+      while (u > px)
+      {
+        ++x;
+        if (x > bound) {
+          // Restart (very rare):
+          x = 0;
+          px = qn;
+          u = unif();
+        } else {
+          u -= px;
+          px = (static_cast<double>(n - x + 1) * p * px) / (static_cast<double>(x) * q);
+        }
+      }
+      return x;
+    }
+
+    // Poisson inversion truncated at n, for p tiny:
+    template <UniformSource U>
+    [[nodiscard]] static auto poissonInversion(U& unif, int const n, double const lambda)
+      -> int
+    {
+      int x = 0;
+      double px = std::exp(-lambda);
+      double u = unif();
+      while (u > px && x < n)
+      {
+        ++x;
+        u -= px;
+        px *= lambda / static_cast<double>(x);
+      }
+      return x;
+    }
+
+    // BTPE, for n*p large (p <= 0.5):
+    template <UniformSource U>
+    [[nodiscard]] auto binomialBtpe(U& unif, int const n, double const p)
+      -> int
+    {
+      BtpeSetup& b = m_btpe;
+      if (b.n != n || b.p != p) {
+        b.n = n;
+        b.p = p;
+        b.r = p;
+        b.q = 1.0 - p;
+        b.fm = static_cast<double>(n) * b.r + b.r;
+        b.m = static_cast<int>(std::floor(b.fm));
+        b.p1 = std::floor(2.195 * std::sqrt(static_cast<double>(n) * b.r * b.q) - 4.6 * b.q) + 0.5;
+        b.xm = static_cast<double>(b.m) + 0.5;
+        b.xl = b.xm - b.p1;
+        b.xr = b.xm + b.p1;
+        b.c = 0.134 + 20.5 / (15.3 + static_cast<double>(b.m));
+        double a = (b.fm - b.xl) / (b.fm - b.xl * b.r);
+        b.laml = a * (1.0 + a / 2.0);
+        a = (b.xr - b.fm) / (b.xr * b.q);
+        b.lamr = a * (1.0 + a / 2.0);
+        b.p2 = b.p1 * (1.0 + 2.0 * b.c);
+        b.p3 = b.p2 + b.c / b.laml;
+        b.p4 = b.p3 + b.c / b.lamr;
+      }
+
+      double const nn = static_cast<double>(n);
+      double const nrq = nn * b.r * b.q;
+
+      while (true)
+      {
+        double const u = unif() * b.p4;
+        double v = unif();
+        int y = 0;
+
+        if (u <= b.p1) {
+          // Triangular region - accept immediately:
+          y = static_cast<int>(std::floor(b.xm - b.p1 * v + u));
+          return y;
+        } else if (u <= b.p2) {
+          // Parallelogram region:
+          double const x = b.xl + (u - b.p1) / b.c;
+          v = v * b.c + 1.0 - std::abs(static_cast<double>(b.m) - x + 0.5) / b.p1;
+          if (v > 1.0) continue;
+          y = static_cast<int>(std::floor(x));
+        } else if (u <= b.p3) {
+          // Left exponential tail:
+          if (v == 0.0) continue;
+          double const x = std::floor(b.xl + std::log(v) / b.laml);
+          if (x < 0.0) continue;
+          y = static_cast<int>(x);
+          v = v * (u - b.p2) * b.laml;
+        } else {
+          // Right exponential tail:
+          if (v == 0.0) continue;
+          double const x = std::floor(b.xr - std::log(v) / b.lamr);
+          if (x > nn) continue;
+          y = static_cast<int>(x);
+          v = v * (u - b.p3) * b.lamr;
+        }
+
+        int const k = std::abs(y - b.m);
+        if (k <= 20 || static_cast<double>(k) >= nrq / 2.0 - 1.0) {
+          // Explicit evaluation of f(y)/f(m):
+          double const s = b.r / b.q;
+          double const a = s * (nn + 1.0);
+          double f = 1.0;
+          if (b.m < y) {
+            for (int i = b.m + 1; i <= y; ++i) f *= (a / static_cast<double>(i) - s);
+          } else if (b.m > y) {
+            for (int i = y + 1; i <= b.m; ++i) f /= (a / static_cast<double>(i) - s);
+          }
+          if (v <= f) return y;
+          continue;
+        }
+
+        // Squeezing using upper and lower bounds on log(f(y)):
+        double const kk = static_cast<double>(k);
+        double const rho = (kk / nrq) * ((kk * (kk / 3.0 + 0.625) + 0.16666666666666666) / nrq + 0.5);
+        double const t = -kk * kk / (2.0 * nrq);
+        double const aa = std::log(v);
+        if (aa < (t - rho)) return y;
+        if (aa > (t + rho)) continue;
+
+        // Final acceptance/rejection test using Stirling's formula:
+        double const x1 = static_cast<double>(y) + 1.0;
+        double const f1 = static_cast<double>(b.m) + 1.0;
+        double const z = nn + 1.0 - static_cast<double>(b.m);
+        double const w = nn - static_cast<double>(y) + 1.0;
+        auto const stirling = [](double const val) {
+          double const v2 = val * val;
+          return (13860.0 - (462.0 - (132.0 - (99.0 - 140.0 / v2) / v2) / v2) / v2) / val / 166320.0;
+        };
+        double const bound = b.xm * std::log(f1 / x1) + (nn - static_cast<double>(b.m) + 0.5) * std::log(z / w) +
+          static_cast<double>(y - b.m) * std::log(w * b.r / (x1 * b.q)) +
+          stirling(f1) + stirling(z) + stirling(x1) + stirling(w);
+        if (aa <= bound) return y;
+      }
+    }
+
+    // Transformed rejection with squeeze, for lambda large:
+    template <UniformSource U>
+    [[nodiscard]] static auto poissonPtrs(U& unif, double const lambda)
+      -> int
+    {
+      double const slam = std::sqrt(lambda);
+      double const loglam = std::log(lambda);
+      double const b = 0.931 + 2.53 * slam;
+      double const a = -0.059 + 0.02483 * b;
+      double const invalpha = 1.1239 + 1.1328 / (b - 3.4);
+      double const vr = 0.9277 - 3.6224 / (b - 2.0);
+
+      while (true)
+      {
+        double const u = unif() - 0.5;
+        double const v = unif();
+        double const us = 0.5 - std::abs(u);
+        double const k = std::floor((2.0 * a / us + b) * u + lambda + 0.43);
+        if (us >= 0.07 && v <= vr) return static_cast<int>(k);
+        if (k < 0.0 || (us < 0.013 && v > us)) continue;
+        if ((std::log(v) + std::log(invalpha) - std::log(a / (us * us) + b)) <= (-lambda + k * loglam - std::lgamma(k + 1.0))) {
+          return static_cast<int>(k);
+        }
+      }
+    }
+
+  public:
+    Sampler() = default;
+
+    // Binomial draw for any n and p:
+    template <UniformSource U>
+    [[nodiscard]] auto rbinom(U& unif, int const n, double const p)
+      -> int
+    {
+      if (n <= 0 || p <= 0.0) return 0;
+      if (p >= 1.0) return n;
+
+      // Work with p <= 0.5:
+      double const pp = std::min(p, 1.0 - p);
+      double const np = static_cast<double>(n) * pp;
+
+      int const rv = [&](){
+        if (np < s_inversion_np) {
+          if (pp < s_poisson_p) return poissonInversion(unif, n, np);
+          return binomialInversion(unif, n, pp);
+        }
+        return binomialBtpe(unif, n, pp);
+      }();
+
+      return p > 0.5 ? n - rv : rv;
+    }
+
+    // Poisson draw (used for tau-leaping), with lambda <= 0 giving 0:
+    template <UniformSource U>
+    [[nodiscard]] static auto rpois(U& unif, double const lambda)
+      -> int
+    {
+      if (!(lambda > 0.0)) return 0;
+      if (lambda >= s_ptrs_lambda) return poissonPtrs(unif, lambda);
+      // Truncation far into the tail just guards against rounding error in the search:
+      return poissonInversion(unif, static_cast<int>(lambda + 40.0 * std::sqrt(lambda) + 40.0), lambda);
+    }
+
+    // Multinomial draw by conditional binomials, with early exit once everything is allocated:
+    template <UniformSource U>
+    auto rmultinom(U& unif, int const n, std::span<double const> const prob, std::span<int> const out)
+      -> void
+    {
+      std::fill(out.begin(), out.end(), 0);
+      if (out.empty()) return;
+
+      int remaining = n;
+      double pp = 1.0;
+      for (index i = 0; i < (ssize(prob)-1) && remaining > 0; ++i)
+      {
+        int const tt = rbinom(unif, remaining, prob[i] / pp);
+        out[i] = tt;
+        pp -= prob[i];
+        remaining -= tt;
+      }
+      out.back() += remaining;
+    }
+
+    // Specialised equal-probability multinomial (e.g. for distributing a total over sub-compartments):
+    template <UniformSource U>
+    auto rmultinomEqual(U& unif, int const n, std::span<int> const out)
+      -> void
+    {
+      std::fill(out.begin(), out.end(), 0);
+      index const k = ssize(out);
+      if (k == 0) return;
+
+      if (n < k) {
+        // Fewer items than boxes - drop each item into a box directly:
+        for (int i = 0; i < n; ++i)
+        {
+          index const box = std::min(static_cast<index>(unif() * static_cast<double>(k)), k-1);
+          ++out[box];
+        }
+      } else {
+        // Conditional binomials with probability 1/(number of boxes remaining):
+        int remaining = n;
+        for (index i = 0; i < (k-1) && remaining > 0; ++i)
+        {
+          int const tt = rbinom(unif, remaining, 1.0 / static_cast<double>(k-i));
+          out[i] = tt;
+          remaining -= tt;
+        }
+        out.back() += remaining;
+      }
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_SAMPLERS_H
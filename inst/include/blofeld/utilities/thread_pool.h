@@ -0,0 +1,151 @@
+#ifndef BLOFELD_THREAD_POOL_H
+#define BLOFELD_THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <utility>
+
+#include "../utilities/tools.h"
+
+/*
+  Persistent pool of worker threads for data-parallel loops:  parallelFor
+  splits [0,n) into chunks that are claimed dynamically by the workers and
+  the calling thread, and returns once every chunk is done.  The threads are
+  created once and sleep between calls, so the pool can be re-used for every
+  time step (and across calls from R).  The first exception thrown by the
+  loop body stops any further chunks from being claimed, and is re-thrown on
+  the calling thread.
+*/
+
+namespace blofeld
+{
+
+  class ThreadPool
+  {
+  private:
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    long m_generation = 0;
+    int m_pending = 0;
+    bool m_stop = false;
+
+    // The current loop:
+    std::function<void(index, index)> m_body;
+    std::atomic<index> m_next { 0 };
+    index m_n = 0;
+    index m_grain = 1;
+    std::exception_ptr m_error;
+
+    // Chunks per thread, to balance the load when iterations differ in cost:
+    static constexpr index s_chunks_per_thread = 8;
+
+    auto runChunks()
+      -> void
+    {
+      while (true)
+      {
+        index const begin = m_next.fetch_add(m_grain, std::memory_order_relaxed);
+        if (begin >= m_n) break;
+        try {
+          m_body(begin, std::min(begin + m_grain, m_n));
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(m_mutex);
+          if (!m_error) m_error = std::current_exception();
+          m_next.store(m_n, std::memory_order_relaxed);
+        }
+      }
+    }
+
+    auto workerLoop()
+      -> void
+    {
+      long seen = 0;
+      while (true)
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_start.wait(lock, [&]{ return m_stop || m_generation != seen; });
+        if (m_stop) return;
+        seen = m_generation;
+        lock.unlock();
+
+        runChunks();
+
+        lock.lock();
+        if (--m_pending == 0) m_done.notify_one();
+      }
+    }
+
+  public:
+    // Note: n_threads includes the calling thread, so n_threads-1 workers are started
+    explicit ThreadPool(int const n_threads)
+    {
+      for (int i=1; i<n_threads; ++i)
+      {
+        m_threads.emplace_back([this](){ workerLoop(); });
+      }
+    }
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_start.notify_all();
+      for (auto& thread : m_threads) thread.join();
+    }
+
+    [[nodiscard]] auto nThreads() const noexcept
+      -> int
+    {
+      return static_cast<int>(ssize(m_threads)) + 1;
+    }
+
+    // Call body(begin, end) over chunks covering [0,n), blocking until all are done:
+    template <typename F>
+    auto parallelFor(index const n, F&& body)
+      -> void
+    {
+      if (n <= 0) return;
+      if (m_threads.empty()) {
+        body(0, n);
+        return;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_body = std::forward<F>(body);
+        m_n = n;
+        m_grain = std::max<index>(1, n / (s_chunks_per_thread * nThreads()));
+        m_next.store(0, std::memory_order_relaxed);
+        m_error = nullptr;
+        m_pending = static_cast<int>(ssize(m_threads));
+        m_generation++;
+      }
+      m_start.notify_all();
+
+      runChunks();
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_done.wait(lock, [&]{ return m_pending == 0; });
+      m_body = nullptr;
+      if (m_error) std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+
+  };
+
+} // namespace blofeld
+
+#endif // BLOFELD_THREAD_POOL_H
@@ -0,0 +1,44 @@
+/*
+ * Checks for Compartment:
+ * - the proportions from makeTakeProp with the rate-to-proportion cache
+ *   (frozen or not) match those from a new compartment for every call,
+ *   when the rates change between calls
+ * See checks.R for usage
+ */
+
+// [[Rcpp::plugins(cpp20)]]
+
+#include <Rcpp.h>
+
+#include "../../inst/include/blofeld/utilities/bridge_rcpp.h"
+#include "../../inst/include/blofeld/utilities/container_formatter.h"
+#include "../../inst/include/blofeld/compartmental/compartment.h"
+
+constexpr struct
+{
+  bool const debug = false;
+  double const tol = 0.00001;
+  using Bridge = blofeld::BridgeRcpp;
+} cts;
+
+using Comp = blofeld::Compartment<cts, blofeld::ModelType::Stochastic, blofeld::compartment_info(3)>;
+
+// makeTakeProp for each rate in turn from one compartment, and from a new compartment for each rate:
+// [[Rcpp::export]]
+Rcpp::DataFrame props_cache_check(Rcpp::NumericVector const& rates, bool const frozen)
+{
+  blofeld::BridgeRcpp bridge;
+  Comp cached(bridge, 100);
+  if (frozen) cached.freezeRates();
+
+  Rcpp::NumericVector prop(rates.size());
+  Rcpp::NumericVector expected(rates.size());
+  for (int i=0; i<rates.size(); ++i) {
+    prop[i] = cached.makeTakeProp(rates[i]);
+    Comp fresh(bridge, 100);
+    expected[i] = fresh.makeTakeProp(rates[i]);
+  }
+
+  using namespace Rcpp;
+  return DataFrame::create(_["Rate"] = rates, _["Frozen"] = LogicalVector(rates.size(), frozen), _["Prop"] = prop, _["Expected"] = expected);
+}
@@ -0,0 +1,181 @@
+/*
+ * Checks for the tau-leaping and exact (Gillespie) integrators:  the mean
+ * state after a fixed duration should match a fixed-step run with a very
+ * small time step, both for a single group (Integrator::TauLeap and
+ * Integrator::Exact with either ExactMethod) and for a matrix population
+ * (Integrator::Exact, i.e. the population-scale next reaction method)
+ * See checks.R for usage
+ */
+
+// [[Rcpp::plugins(cpp20)]]
+
+#include <Rcpp.h>
+
+#include <string>
+#include <vector>
+
+#include "../../inst/include/blofeld/utilities/bridge_rcpp.h"
+#include "../../inst/include/blofeld/utilities/container_formatter.h"
+#include "../../inst/include/blofeld/compartmental/compartment.h"
+#include "../../inst/include/blofeld/compartmental/seidrvmz_group.h"
+#include "../../inst/include/blofeld/populations/matrix_population.h"
+
+constexpr struct
+{
+  bool const debug = false;
+  double const tol = 0.00001;
+  using Bridge = blofeld::BridgeRcpp;
+} cts;
+
+using SG = blofeld::SEIDRVMZgroup<cts, blofeld::ModelType::Stochastic,
+  blofeld::compartment_info(1), // S
+  blofeld::compartment_info(3), // E
+  blofeld::compartment_info(0), // L
+  blofeld::compartment_info(2), // I
+  blofeld::compartment_info(0), // D
+  blofeld::compartment_info(1), // R
+  blofeld::compartment_info(1), // V
+  blofeld::compartment_info(1), // M
+  blofeld::compartment_info(1, blofeld::ContainerType::BirthDeath)  // Z
+  >;
+
+// Set the integrator from its name ("FixedStep", "TauLeap", "Direct" or "NextReaction"):
+template <class T>
+void setIntegrator(blofeld::BridgeRcpp& bridge, T& obj, std::string const& integrator)
+{
+  if (integrator == "FixedStep") {
+    obj.setIntegrator(blofeld::Integrator::FixedStep);
+  } else if (integrator == "TauLeap") {
+    obj.setIntegrator(blofeld::Integrator::TauLeap);
+  } else if (integrator == "Direct" || integrator == "NextReaction") {
+    obj.setIntegrator(blofeld::Integrator::Exact);
+    if constexpr (requires (T& gp) { gp.setExactMethod(blofeld::ExactMethod::Direct); }) {
+      obj.setExactMethod(integrator == "Direct" ? blofeld::ExactMethod::Direct : blofeld::ExactMethod::NextReaction);
+    }
+  } else {
+    bridge.stop("Unrecognised integrator '{}'", integrator);
+  }
+}
+
+// Final totals after each replicate, as a data frame:
+struct Totals
+{
+  std::vector<double> S, E, I, R, V, M;
+
+  template <class St>
+  void push_back(St const& state)
+  {
+    S.push_back(state.S);
+    E.push_back(state.E);
+    I.push_back(state.I);
+    R.push_back(state.R);
+    V.push_back(state.V);
+    M.push_back(state.M);
+  }
+
+  [[nodiscard]] auto dataFrame(std::string const& integrator, double const d_time) const
+    -> Rcpp::DataFrame
+  {
+    using namespace Rcpp;
+    return DataFrame::create(
+      _["Integrator"] = StringVector(S.size(), integrator),
+      _["DTime"] = NumericVector(S.size(), d_time),
+      _["S"] = NumericVector(S.begin(), S.end()),
+      _["E"] = NumericVector(E.begin(), E.end()),
+      _["I"] = NumericVector(I.begin(), I.end()),
+      _["R"] = NumericVector(R.begin(), R.end()),
+      _["V"] = NumericVector(V.begin(), V.end()),
+      _["M"] = NumericVector(M.begin(), M.end())
+    );
+  }
+};
+
+void setupGroup(SG& gp, double const d_time, int const n_s, int const n_i)
+{
+  blofeld::SEIDRVMZpars pars;
+  pars.beta_clinical = 0.5;
+  pars.incubation = 0.3;
+  pars.recovery = 0.2;
+  pars.reversion = 0.01;
+  pars.waning = 0.05;
+  pars.vaccination = 0.001;
+  pars.mortality_I = 0.01;
+  pars.death = 0.001;
+  pars.d_time = d_time;
+  gp.set_parameters(pars);
+  gp.set_state(blofeld::SEIDRVMZcomp::S, n_s, true);
+  gp.set_state(blofeld::SEIDRVMZcomp::I, n_i, true);
+}
+
+// Run a single group replicated times over a duration (in units of time, i.e. duration/d_time steps):
+Totals groupTotals(int const reps, std::string const& integrator, double const d_time, double const duration)
+{
+  blofeld::BridgeRcpp bridge;
+  int const steps = static_cast<int>(std::lround(duration / d_time));
+  Totals rv;
+  for (int r=0; r<reps; ++r)
+  {
+    SG gp(bridge);
+    setupGroup(gp, d_time, 200, 10);
+    setIntegrator(bridge, gp, integrator);
+    gp.update(steps);
+    auto const state = gp.get_state();
+    struct { double S, E, I, R, V, M; } tt = {
+      static_cast<double>(state.S.get_sum()), static_cast<double>(state.E.get_sum()), static_cast<double>(state.I.get_sum()),
+      static_cast<double>(state.R.get_sum()), static_cast<double>(state.V.get_sum()), static_cast<double>(state.M.get_sum())
+    };
+    rv.push_back(tt);
+  }
+  return rv;
+}
+
+// Run a chain of n_groups groups (infection starting at one end) replicated times over a duration:
+// Note: "Direct" and "NextReaction" both give Integrator::Exact for the population
+Totals populationTotals(int const reps, int const n_groups, std::string const& integrator, double const d_time, double const duration)
+{
+  blofeld::BridgeRcpp bridge;
+  int const steps = static_cast<int>(std::lround(duration / d_time));
+
+  std::vector<int> from;
+  std::vector<int> to;
+  std::vector<double> beta;
+  for (int i=0; i+1<n_groups; ++i) {
+    from.push_back(i);
+    to.push_back(i+1);
+    beta.push_back(0.003);
+    from.push_back(i+1);
+    to.push_back(i);
+    beta.push_back(0.003);
+  }
+
+  Totals rv;
+  for (int r=0; r<reps; ++r)
+  {
+    std::vector<SG> groups;
+    groups.reserve(n_groups);
+    std::vector<SG*> ptrs;
+    for (int i=0; i<n_groups; ++i) {
+      groups.emplace_back(bridge);
+      setupGroup(groups.back(), d_time, 100, i==0 ? 3 : 0);
+      ptrs.push_back(&groups.back());
+    }
+    blofeld::MatrixPopulation<cts, SG> pop(bridge, ptrs);
+    pop.setBetaEdges(from, to, beta);
+    setIntegrator(bridge, pop, integrator);
+    pop.update(steps);
+    rv.push_back(pop.getState());
+  }
+  return rv;
+}
+
+// [[Rcpp::export]]
+Rcpp::DataFrame group_integrator_check(int const reps, std::string const integrator, double const d_time, double const duration)
+{
+  return groupTotals(reps, integrator, d_time, duration).dataFrame(integrator, d_time);
+}
+
+// [[Rcpp::export]]
+Rcpp::DataFrame population_integrator_check(int const reps, int const n_groups, std::string const integrator, double const d_time, double const duration)
+{
+  return populationTotals(reps, n_groups, integrator, d_time, duration).dataFrame(integrator, d_time);
+}
@@ -0,0 +1,339 @@
+/*
+ * Checks for MatrixPopulation and ReplicatePopulation:
+ * - with BridgeParallel, the result of a fixed-step update does not depend
+ *   on the number of threads, and an error on a worker thread (in a release
+ *   build) is reported as an R error
+ * - beta from a dense matrix, a dgCMatrix, its slots (setBetaCSC) and an
+ *   edge list all use beta[i,j] from group i to group j
+ * - ReplicatePopulation gives the same distribution of totals as the same
+ *   number of independent MatrixPopulation runs from the same initial state
+ * - quiescence gives the same distribution of totals as updating every
+ *   group, and observing quiescent groups does not change the result
+ * See checks.R for usage
+ */
+
+// [[Rcpp::plugins(cpp20)]]
+
+#include <Rcpp.h>
+
+#include <string>
+#include <vector>
+
+#include "../../inst/include/blofeld/utilities/bridge_rcpp.h"
+#include "../../inst/include/blofeld/utilities/bridge_parallel.h"
+#include "../../inst/include/blofeld/utilities/container_formatter.h"
+#include "../../inst/include/blofeld/compartmental/compartment.h"
+#include "../../inst/include/blofeld/compartmental/seidrvmz_group.h"
+#include "../../inst/include/blofeld/populations/matrix_population.h"
+#include "../../inst/include/blofeld/populations/replicate_population.h"
+
+constexpr struct
+{
+  bool const debug = false;
+  double const tol = 0.00001;
+  using Bridge = blofeld::BridgeRcpp;
+} cts;
+
+constexpr struct
+{
+  bool const debug = false;
+  double const tol = 0.00001;
+  using Bridge = blofeld::BridgeParallel<blofeld::BridgeRcpp>;
+} cts_parallel;
+
+template <auto s_cts>
+using Group = blofeld::SEIDRVMZgroup<s_cts, blofeld::ModelType::Stochastic,
+  blofeld::compartment_info(1), // S
+  blofeld::compartment_info(3), // E
+  blofeld::compartment_info(0), // L
+  blofeld::compartment_info(2), // I
+  blofeld::compartment_info(0), // D
+  blofeld::compartment_info(1), // R
+  blofeld::compartment_info(1), // V
+  blofeld::compartment_info(1), // M
+  blofeld::compartment_info(1, blofeld::ContainerType::BirthDeath)  // Z
+  >;
+
+// Groups of n_s animals, with infection in every 10th group, and parameters so that all transitions are used
+// (unless vaccination is zero, which allows groups to become quiescent):
+template <class G>
+auto makeGroups(typename G::Bridge& bridge, int const n_groups, int const n_s, double const vaccination = 0.02)
+  -> std::vector<G>
+{
+  std::vector<G> rv;
+  rv.reserve(n_groups);
+  for (int i=0; i<n_groups; ++i) {
+    rv.emplace_back(bridge);
+    blofeld::SEIDRVMZpars pars;
+    pars.beta_clinical = 0.5;
+    pars.incubation = 0.3;
+    pars.recovery = 0.2;
+    pars.death = 0.01;
+    pars.vaccination = vaccination;
+    pars.mortality_I = 0.05;
+    pars.waning = 0.1;
+    pars.reversion = 0.05;
+    rv.back().set_parameters(pars);
+    rv.back().set_state(blofeld::SEIDRVMZcomp::S, n_s, true);
+    rv.back().set_state(blofeld::SEIDRVMZcomp::I, i%10==0 ? 5 : 0, true);
+  }
+  return rv;
+}
+
+// A group whose update fails (by inserting a negative total into a compartment, which is an error even
+// in release builds) when setFail has been called:
+class FailingGroup : public ::Group<cts_parallel>
+{
+private:
+  Bridge& m_failing_bridge;
+  bool m_fail = false;
+
+public:
+  explicit FailingGroup(Bridge& bridge)
+    : ::Group<cts_parallel>(bridge), m_failing_bridge(bridge)
+  {
+  }
+
+  void setFail()
+  {
+    m_fail = true;
+  }
+
+  void update(int const n_steps = 1)
+  {
+    if (m_fail) {
+      blofeld::Compartment<cts_parallel, blofeld::ModelType::Stochastic, blofeld::compartment_info(1)> extra(m_failing_bridge);
+      extra.insert(-1);
+    }
+    ::Group<cts_parallel>::update(n_steps);
+  }
+};
+
+// Sparse random-looking contacts, with 5 targets per group:
+template <class P>
+void setContacts(P& pop, int const n_groups, double const beta)
+{
+  std::vector<int> from;
+  std::vector<int> to;
+  std::vector<double> values;
+  for (int i=0; i<n_groups; ++i) {
+    for (int k=1; k<=5; ++k) {
+      from.push_back(i);
+      to.push_back((i*7 + k*13) % n_groups);
+      values.push_back(beta);
+    }
+  }
+  pop.setBetaEdges(from, to, values);
+}
+
+// External infection of each group from the given infective, with beta set by one method:  Dense (flattened by rows,
+// as by MatrixPopulationWrapper::setBetaMatrix), Sparse (a dgCMatrix), CSC (its slots) or Edges (its non-zero values):
+// [[Rcpp::export]]
+Rcpp::NumericVector beta_external_check(Rcpp::NumericMatrix const& beta, Rcpp::S4 const& sparse, Rcpp::NumericVector const& infective, std::string const& method)
+{
+  using G = Group<cts>;
+
+  blofeld::BridgeRcpp bridge;
+  int const n_groups = beta.nrow();
+  std::vector<G> groups = makeGroups<G>(bridge, n_groups, 10);
+  std::vector<G*> ptrs;
+  for (auto& gp : groups) ptrs.push_back(&gp);
+  blofeld::MatrixPopulation<cts, G> pop(bridge, ptrs);
+
+  if (method == "Dense") {
+    std::vector<double> vec;
+    for (int i=0; i<n_groups; ++i) {
+      for (int j=0; j<n_groups; ++j) vec.push_back(beta(i,j));
+    }
+    pop.setBetaMatrix(vec);
+  } else if (method == "Sparse") {
+    pop.setBetaMatrix(sparse);
+  } else if (method == "CSC") {
+    pop.setBetaCSC(Rcpp::as<std::vector<int>>(sparse.slot("p")), Rcpp::as<std::vector<int>>(sparse.slot("i")), Rcpp::as<std::vector<double>>(sparse.slot("x")));
+  } else if (method == "Edges") {
+    std::vector<int> from, to;
+    std::vector<double> values;
+    for (int i=0; i<n_groups; ++i) {
+      for (int j=0; j<n_groups; ++j) {
+        if (beta(i,j) == 0.0) continue;
+        from.push_back(i);
+        to.push_back(j);
+        values.push_back(beta(i,j));
+      }
+    }
+    pop.setBetaEdges(from, to, values);
+  } else {
+    Rcpp::stop("Unrecognised method " + method);
+  }
+
+  std::vector<double> const inf(infective.begin(), infective.end());
+  std::vector<double> external(n_groups);
+  pop.computeExternalBatch(inf, 1, external);
+  return Rcpp::NumericVector(external.begin(), external.end());
+}
+
+// Final state of every group after a fixed-step update using the given number of threads, optionally
+// with quiescence (and no vaccination) and reading every group through the const getGroup after each step:
+// [[Rcpp::export]]
+Rcpp::DataFrame population_threads_check(int const n_groups, int const steps, int const threads, int const seed,
+                                         bool const quiescence = false, bool const observe = false)
+{
+  using G = Group<cts_parallel>;
+
+  blofeld::BridgeRcpp main;
+  blofeld::BridgeParallel<blofeld::BridgeRcpp> bridge(main, static_cast<std::uint32_t>(seed));
+
+  std::vector<G> groups = makeGroups<G>(bridge, n_groups, 200, quiescence ? 0.0 : 0.02);
+  std::vector<G*> ptrs;
+  for (auto& gp : groups) ptrs.push_back(&gp);
+  blofeld::MatrixPopulation<cts_parallel, G> pop(bridge, ptrs);
+  setContacts(pop, n_groups, 0.001);
+  pop.setThreads(threads);
+  pop.setQuiescence(quiescence);
+  auto const& observed = pop;
+  for (int s=0; s<steps; ++s) {
+    pop.update(1);
+    if (observe) {
+      for (int i=0; i<n_groups; ++i) static_cast<void>(observed.getGroup(i)->getTotal(blofeld::SEIDRVMZcomp::S));
+    }
+  }
+
+  using namespace Rcpp;
+  IntegerVector group(n_groups);
+  NumericVector time(n_groups);
+  IntegerVector S(n_groups), E(n_groups), I(n_groups), R(n_groups), V(n_groups), M(n_groups);
+  for (int i=0; i<n_groups; ++i) {
+    auto const* gp = pop.getGroup(i);
+    group[i] = i+1;
+    time[i] = gp->getTime();
+    S[i] = gp->getTotal(blofeld::SEIDRVMZcomp::S);
+    E[i] = gp->getTotal(blofeld::SEIDRVMZcomp::E);
+    I[i] = gp->getTotal(blofeld::SEIDRVMZcomp::I);
+    R[i] = gp->getTotal(blofeld::SEIDRVMZcomp::R);
+    V[i] = gp->getTotal(blofeld::SEIDRVMZcomp::V);
+    M[i] = gp->getTotal(blofeld::SEIDRVMZcomp::M);
+  }
+  return DataFrame::create(_["Group"] = group, _["Time"] = time, _["S"] = S, _["E"] = E, _["I"] = I, _["R"] = R, _["V"] = V, _["M"] = M);
+}
+
+// Update with one failing group (the last, which is not updated by the main thread):
+// [[Rcpp::export]]
+int worker_error_check(int const n_groups, int const steps, int const threads)
+{
+  blofeld::BridgeRcpp main;
+  blofeld::BridgeParallel<blofeld::BridgeRcpp> bridge(main, 1U);
+
+  std::vector<FailingGroup> groups = makeGroups<FailingGroup>(bridge, n_groups, 200);
+  groups.back().setFail();
+  std::vector<FailingGroup*> ptrs;
+  for (auto& gp : groups) ptrs.push_back(&gp);
+  blofeld::MatrixPopulation<cts_parallel, FailingGroup> pop(bridge, ptrs);
+  setContacts(pop, n_groups, 0.001);
+  pop.setThreads(threads);
+  pop.update(steps);
+
+  return steps;
+}
+
+// Totals over groups for each replicate, either from ReplicatePopulation or from independent runs:
+// Note: replicates copy the sub-compartments of the initial population, so the independent runs
+// start from copies of the same groups (rather than re-distributing the initial values)
+// [[Rcpp::export]]
+Rcpp::DataFrame replicate_population_check(int const nrep, int const n_groups, int const steps, bool const batched)
+{
+  using G = Group<cts>;
+
+  blofeld::BridgeRcpp bridge;
+
+  std::vector<double> S, E, I, R, V, M;
+  auto const add = [&](auto const& state) {
+    S.push_back(state.S);
+    E.push_back(state.E);
+    I.push_back(state.I);
+    R.push_back(state.R);
+    V.push_back(state.V);
+    M.push_back(state.M);
+  };
+
+  auto const makePopulation = [&](std::vector<G>& groups) {
+    std::vector<G*> ptrs;
+    for (auto& gp : groups) ptrs.push_back(&gp);
+    blofeld::MatrixPopulation<cts, G> pop(bridge, ptrs);
+    setContacts(pop, n_groups, 0.002);
+    return pop;
+  };
+
+  std::vector<G> const initial = makeGroups<G>(bridge, n_groups, 100);
+  if (batched) {
+    std::vector<G> groups = initial;
+    auto pop = makePopulation(groups);
+    blofeld::ReplicatePopulation<cts, G> reps(bridge, pop, nrep);
+    reps.update(steps);
+    for (int r=0; r<nrep; ++r) add(reps.getState(r));
+  } else {
+    for (int r=0; r<nrep; ++r) {
+      std::vector<G> groups = initial;
+      auto pop = makePopulation(groups);
+      pop.update(steps);
+      add(pop.getState());
+    }
+  }
+
+  using namespace Rcpp;
+  return DataFrame::create(
+    _["Method"] = StringVector(S.size(), batched ? "ReplicatePopulation" : "Independent"),
+    _["S"] = NumericVector(S.begin(), S.end()),
+    _["E"] = NumericVector(E.begin(), E.end()),
+    _["I"] = NumericVector(I.begin(), I.end()),
+    _["R"] = NumericVector(R.begin(), R.end()),
+    _["V"] = NumericVector(V.begin(), V.end()),
+    _["M"] = NumericVector(M.begin(), M.end())
+  );
+}
+
+// Totals over groups for each run, with or without quiescence (and no vaccination), and the
+// mean proportion of groups that were updated in each step (which is lower for lower beta between groups):
+// [[Rcpp::export]]
+Rcpp::DataFrame quiescence_check(int const nrep, int const n_groups, int const steps, double const beta, bool const quiescence)
+{
+  using G = Group<cts>;
+
+  blofeld::BridgeRcpp bridge;
+
+  std::vector<double> S, E, I, R, V, M, active;
+  std::vector<G> const initial = makeGroups<G>(bridge, n_groups, 100, 0.0);
+  for (int r=0; r<nrep; ++r) {
+    std::vector<G> groups = initial;
+    std::vector<G*> ptrs;
+    for (auto& gp : groups) ptrs.push_back(&gp);
+    blofeld::MatrixPopulation<cts, G> pop(bridge, ptrs);
+    setContacts(pop, n_groups, beta);
+    pop.setQuiescence(quiescence);
+
+    double updated = 0.0;
+    for (int s=0; s<steps; ++s) {
+      pop.update(1);
+      updated += static_cast<double>(pop.nActive()) / static_cast<double>(n_groups * steps);
+    }
+    auto const state = pop.getState();
+    S.push_back(state.S);
+    E.push_back(state.E);
+    I.push_back(state.I);
+    R.push_back(state.R);
+    V.push_back(state.V);
+    M.push_back(state.M);
+    active.push_back(updated);
+  }
+
+  using namespace Rcpp;
+  return DataFrame::create(
+    _["Quiescence"] = LogicalVector(S.size(), quiescence),
+    _["S"] = NumericVector(S.begin(), S.end()),
+    _["E"] = NumericVector(E.begin(), E.end()),
+    _["I"] = NumericVector(I.begin(), I.end()),
+    _["R"] = NumericVector(R.begin(), R.end()),
+    _["V"] = NumericVector(V.begin(), V.end()),
+    _["M"] = NumericVector(M.begin(), M.end()),
+    _["Active"] = NumericVector(active.begin(), active.end())
+  );
+}
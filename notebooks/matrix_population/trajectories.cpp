@@ -0,0 +1,116 @@
+/*
+ * Groups and matrix populations using the current (non-legacy) code, with
+ * trajectory output:  recorded in memory (run), as an event log (runEvents),
+ * or written to a trajectory file (runStore) that is then read lazily
+ * (TrajectoryReader).  See trajectories.R for usage
+ */
+constexpr int numE = 0;
+constexpr int numI = 3;
+constexpr int numR = 1;
+constexpr bool debug = false;
+
+
+// [[Rcpp::plugins(cpp20)]]
+
+#include <Rcpp.h>
+
+#include "../../inst/include/blofeld/utilities/bridge_rcpp.h"
+#include "../../inst/include/blofeld/utilities/container_formatter.h"
+#include "../../inst/include/blofeld/compartmental/compartment.h"
+#include "../../inst/include/blofeld/compartmental/seidrvmz_group.h"
+#include "../../inst/include/blofeld/rcpp_wrappers/group_wrapper.h"
+#include "../../inst/include/blofeld/rcpp_wrappers/matrix_population_wrapper.h"
+#include "../../inst/include/blofeld/rcpp_wrappers/trajectory_wrapper.h"
+#include "../../inst/include/blofeld/rcpp_wrappers/rcpp_module_macros.h"
+
+constexpr struct
+{
+  bool const debug = false;
+  double const tol = 0.00001;
+  using Bridge = blofeld::BridgeRcpp;
+} cts {
+  .debug = debug
+};
+
+using SG = blofeld::SEIDRVMZgroup<cts, blofeld::ModelType::Stochastic,
+  blofeld::compartment_info(1), // S
+  blofeld::compartment_info(numE), // E
+  blofeld::compartment_info(0), // L
+  blofeld::compartment_info(numI), // I
+  blofeld::compartment_info(0), // D
+  blofeld::compartment_info(numR), // R
+  blofeld::compartment_info(0), // V
+  blofeld::compartment_info(1), // M
+  blofeld::compartment_info(1, blofeld::ContainerType::BirthDeath)  // Z
+  >;
+
+using DG = blofeld::SEIDRVMZgroup<cts, blofeld::ModelType::Deterministic,
+  blofeld::compartment_info(1), // S
+  blofeld::compartment_info(numE), // E
+  blofeld::compartment_info(0), // L
+  blofeld::compartment_info(numI), // I
+  blofeld::compartment_info(0), // D
+  blofeld::compartment_info(numR), // R
+  blofeld::compartment_info(0), // V
+  blofeld::compartment_info(1), // M
+  blofeld::compartment_info(1, blofeld::ContainerType::BirthDeath)  // Z
+  >;
+
+using StochasticGroup = blofeld::GroupWrapper<cts, SG>;
+RCPP_EXPOSED_AS(StochasticGroup)
+RCPP_EXPOSED_WRAP(StochasticGroup)
+
+using DeterministicGroup = blofeld::GroupWrapper<cts, DG>;
+RCPP_EXPOSED_AS(DeterministicGroup)
+RCPP_EXPOSED_WRAP(DeterministicGroup)
+
+using StochasticPop = blofeld::MatrixPopulationWrapper<cts, SG>;
+RCPP_EXPOSED_AS(StochasticPop)
+RCPP_EXPOSED_WRAP(StochasticPop)
+
+using DeterministicPop = blofeld::MatrixPopulationWrapper<cts, DG>;
+RCPP_EXPOSED_AS(DeterministicPop)
+RCPP_EXPOSED_WRAP(DeterministicPop)
+
+using TrajectoryReader = blofeld::TrajectoryReaderWrapper<blofeld::BridgeRcpp>;
+RCPP_EXPOSED_AS(TrajectoryReader)
+RCPP_EXPOSED_WRAP(TrajectoryReader)
+
+RCPP_MODULE(blofeld_trajectories){
+  using namespace Rcpp;
+
+  GROUP_CLASS(StochasticGroup)
+  GROUP_CLASS(DeterministicGroup)
+
+  class_<StochasticPop>("StochasticPop")
+    .constructor<Rcpp::List>("C'tor")
+    .method("show", &StochasticPop::show)
+    .method("update", &StochasticPop::update)
+    .method("run", &StochasticPop::run)
+    .method("runEvents", &StochasticPop::runEvents)
+    .method("runStore", &StochasticPop::runStore)
+    .method("getState", &StochasticPop::getState)
+    .method("setBetaMatrix", &StochasticPop::setBetaMatrix)
+    .method("setBetaSparse", &StochasticPop::setBetaSparse)
+  ;
+
+  class_<DeterministicPop>("DeterministicPop")
+    .constructor<Rcpp::List>("C'tor")
+    .method("show", &DeterministicPop::show)
+    .method("update", &DeterministicPop::update)
+    .method("run", &DeterministicPop::run)
+    .method("runEvents", &DeterministicPop::runEvents)
+    .method("runStore", &DeterministicPop::runStore)
+    .method("getState", &DeterministicPop::getState)
+    .method("setBetaMatrix", &DeterministicPop::setBetaMatrix)
+    .method("setBetaSparse", &DeterministicPop::setBetaSparse)
+  ;
+
+  class_<TrajectoryReader>("TrajectoryReader")
+    .constructor<std::string>("C'tor")
+    .method("show", &TrajectoryReader::show)
+    .method("slice", &TrajectoryReader::slice)
+    .method("nRecords", &TrajectoryReader::nRecords)
+    .method("nGroups", &TrajectoryReader::nGroups)
+  ;
+}
@@ -0,0 +1,229 @@
+/*
+ * Round-trip checks for the output classes, against the (uncompressed)
+ * TrajectoryRecorder observing the same run:
+ * - TrajectoryCodec encode/decode of arbitrary integer frames
+ * - CompressedTrajectory::readSlice
+ * - EventLog::stateAt
+ * - TrajectoryStore written to disk and read back by TrajectoryReader
+ * - TrajectoryReader rejecting files with corrupt headers
+ * See checks.R for usage
+ */
+
+// [[Rcpp::plugins(cpp20)]]
+
+#include <Rcpp.h>
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <fstream>
+#include <exception>
+
+#include "../../inst/include/blofeld/utilities/bridge_rcpp.h"
+#include "../../inst/include/blofeld/utilities/container_formatter.h"
+#include "../../inst/include/blofeld/compartmental/compartment.h"
+#include "../../inst/include/blofeld/compartmental/seidrvmz_group.h"
+#include "../../inst/include/blofeld/populations/matrix_population.h"
+#include "../../inst/include/blofeld/output/trajectory_recorder.h"
+#include "../../inst/include/blofeld/output/trajectory_codec.h"
+#include "../../inst/include/blofeld/output/event_log.h"
+#include "../../inst/include/blofeld/output/trajectory_store.h"
+
+constexpr struct
+{
+  bool const debug = false;
+  double const tol = 0.00001;
+  using Bridge = blofeld::BridgeRcpp;
+} cts;
+
+using SG = blofeld::SEIDRVMZgroup<cts, blofeld::ModelType::Stochastic,
+  blofeld::compartment_info(1), // S
+  blofeld::compartment_info(3), // E
+  blofeld::compartment_info(0), // L
+  blofeld::compartment_info(2), // I
+  blofeld::compartment_info(0), // D
+  blofeld::compartment_info(1), // R
+  blofeld::compartment_info(1), // V
+  blofeld::compartment_info(1), // M
+  blofeld::compartment_info(1, blofeld::ContainerType::BirthDeath)  // Z
+  >;
+
+// Number of frames (of the given width) that do not survive encoding and decoding in blocks of block_records,
+// where frames are random walks with occasional large jumps (and some repeated frames):
+// [[Rcpp::export]]
+int codec_round_trip(int const records, int const width, int const block_records)
+{
+  std::vector<std::vector<int>> frames;
+  std::vector<int> frame(width, 0);
+  for (int r=0; r<records; ++r) {
+    if (R::unif_rand() < 0.8) {
+      for (auto& val : frame) {
+        double const u = R::unif_rand();
+        if (u < 0.01) {
+          val = static_cast<int>((R::unif_rand() - 0.5) * 2.0e9);
+        } else if (u < 0.5) {
+          val += static_cast<int>(R::unif_rand() * 21.0) - 10;
+        }
+      }
+    }
+    frames.push_back(frame);
+  }
+
+  blofeld::TrajectoryCodec codec(width, block_records);
+  for (int r=0; r<records; ++r) codec.append(static_cast<double>(r), std::span<int const>(frames[r]));
+
+  int bad = 0;
+  auto const check = [&](blofeld::index const rr, std::span<int const> const decoded) {
+    for (int i=0; i<width; ++i) {
+      if (decoded[i] != frames[rr][i]) {
+        ++bad;
+        break;
+      }
+    }
+  };
+  // All records, and then each record on its own (which starts mid-block):
+  codec.decode(0, records, check);
+  for (int r=0; r<records; ++r) codec.decode(r, 1, check);
+  return bad;
+}
+
+// Number of mismatched values for each output class against the recorder, over all records of a population run:
+// [[Rcpp::export]]
+Rcpp::DataFrame output_round_trip(int const n_groups, int const steps, std::string const& path)
+{
+  blofeld::BridgeRcpp bridge;
+
+  // Infection in every 10th group, so that most groups are unchanged for most of the run:
+  std::vector<SG> groups;
+  groups.reserve(n_groups);
+  for (int i=0; i<n_groups; ++i) {
+    groups.emplace_back(bridge);
+    blofeld::SEIDRVMZpars pars;
+    pars.beta_clinical = 0.3;
+    pars.incubation = 0.2;
+    pars.recovery = 0.1;
+    pars.death = 0.0005;
+    groups.back().set_parameters(pars);
+    groups.back().set_state(blofeld::SEIDRVMZcomp::S, 1000, true);
+    groups.back().set_state(blofeld::SEIDRVMZcomp::I, i%10==0 ? 3 : 0, true);
+  }
+  std::vector<SG*> ptrs;
+  for (auto& gp : groups) ptrs.push_back(&gp);
+  blofeld::MatrixPopulation<cts, SG> pop(bridge, ptrs);
+
+  std::vector<blofeld::SEIDRVMZcomp> const comps { blofeld::SEIDRVMZcomp::S, blofeld::SEIDRVMZcomp::E, blofeld::SEIDRVMZcomp::I, blofeld::SEIDRVMZcomp::R, blofeld::SEIDRVMZcomp::M };
+  blofeld::index const ncomp = blofeld::ssize(comps);
+
+  blofeld::TrajectoryRecorder<blofeld::BridgeRcpp, int> recorder(bridge, comps, 1, true);
+  blofeld::CompressedTrajectory<blofeld::BridgeRcpp> compressed(bridge, comps, n_groups, 1, 64);
+  blofeld::EventLog<blofeld::BridgeRcpp, int> events(bridge, comps, n_groups);
+  blofeld::TrajectoryStore<blofeld::BridgeRcpp, int> store(bridge, path, comps, n_groups, 1);
+
+  // The initial state, then after every step:
+  for (int s=0; s<=steps; ++s) {
+    if (s > 0) pop.update(1);
+    recorder.observe(pop);
+    compressed.observe(pop);
+    events.observe(pop);
+    store.observe(pop);
+  }
+  store.close();
+
+  blofeld::index const nrec = recorder.nRecords() / n_groups;
+  auto const expected = [&](blofeld::index const rr, int const gg, blofeld::index const kk) {
+    return static_cast<double>(recorder.getValues(kk)[rr*n_groups + gg]);
+  };
+
+  std::vector<int> all(n_groups);
+  for (int i=0; i<n_groups; ++i) all[i] = i;
+
+  // Slices are [record][group][compartment]:
+  auto const compareSlice = [&](auto const& slice) {
+    int bad = 0;
+    for (blofeld::index rr=0; rr<nrec; ++rr) {
+      for (int gg=0; gg<n_groups; ++gg) {
+        for (blofeld::index kk=0; kk<ncomp; ++kk) {
+          if (static_cast<double>(slice[(rr*n_groups + gg)*ncomp + kk]) != expected(rr, gg, kk)) ++bad;
+        }
+      }
+    }
+    return bad;
+  };
+
+  int bad_events = 0;
+  for (blofeld::index rr=0; rr<nrec; ++rr) {
+    auto const state = events.stateAt(recorder.getTimes()[rr*n_groups]);
+    for (int gg=0; gg<n_groups; ++gg) {
+      for (blofeld::index kk=0; kk<ncomp; ++kk) {
+        if (static_cast<double>(state[gg*ncomp + kk]) != expected(rr, gg, kk)) ++bad_events;
+      }
+    }
+  }
+
+  blofeld::TrajectoryReader<blofeld::BridgeRcpp> reader(bridge, path);
+  int bad_store = reader.nRecords() == nrec ? compareSlice(reader.readSlice(all, 0, nrec)) : 1;
+  if (reader.findRecord(recorder.getTimes()[(nrec/2)*n_groups]) != nrec/2) ++bad_store;
+
+  using namespace Rcpp;
+  return DataFrame::create(
+    _["Output"] = StringVector::create("CompressedTrajectory", "EventLog", "TrajectoryStore"),
+    _["Records"] = IntegerVector::create(compressed.nRecords(), nrec, reader.nRecords()),
+    _["Mismatches"] = IntegerVector::create(compareSlice(compressed.readSlice(all, 0, compressed.nRecords())), bad_events, bad_store)
+  );
+}
+
+// Whether TrajectoryReader rejects a (valid) file after each of a set of corruptions of its header:
+// [[Rcpp::export]]
+Rcpp::DataFrame corrupt_header_check(std::string const& path)
+{
+  blofeld::BridgeRcpp bridge;
+  std::vector<blofeld::SEIDRVMZcomp> const comps { blofeld::SEIDRVMZcomp::S, blofeld::SEIDRVMZcomp::I };
+  {
+    SG group(bridge);
+    group.set_state(blofeld::SEIDRVMZcomp::S, 10, true);
+    blofeld::TrajectoryStore<blofeld::BridgeRcpp, int> store(bridge, path, comps, 1, 1);
+    store.record(group);
+    store.close();
+  }
+
+  auto const rejected = [&]() {
+    try {
+      blofeld::TrajectoryReader<blofeld::BridgeRcpp> reader(bridge, path);
+    } catch (std::exception const&) {
+      return true;
+    }
+    return false;
+  };
+
+  // Overwrite a header field, returning the original bytes:
+  auto const patch = [&](std::size_t const offset, auto const value) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    auto original = value;
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(reinterpret_cast<char*>(&original), sizeof(value));
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(reinterpret_cast<char const*>(&value), sizeof(value));
+    return original;
+  };
+
+  using Header = blofeld::TrajectoryHeader;
+  std::vector<std::string> corruption { "None" };
+  std::vector<int> result { rejected() };
+  auto const check = [&](std::string const& name, std::size_t const offset, auto const value) {
+    auto const original = patch(offset, value);
+    corruption.push_back(name);
+    result.push_back(rejected());
+    patch(offset, original);
+  };
+  check("DataOffsetInHeader", offsetof(Header, data_offset), std::uint64_t { 8U });
+  check("DataOffsetPastEnd", offsetof(Header, data_offset), std::uint64_t { 1U } << 40U);
+  check("RecordsOverflow", offsetof(Header, n_records), std::uint64_t { 1U } << 62U);
+  check("CompartmentCode", offsetof(Header, compartments) + 1U, std::uint8_t { 200U });
+
+  using namespace Rcpp;
+  return DataFrame::create(
+    _["Corruption"] = StringVector(corruption.begin(), corruption.end()),
+    _["Rejected"] = LogicalVector(result.begin(), result.end())
+  );
+}
@@ -0,0 +1,133 @@
+/*
+ * Benchmarks for the native binomial sampler (blofeld::Sampler) against
+ * R::rbinom and std::binomial_distribution (libstdc++ or libc++)
+ * See benchmark.R for usage
+ */
+
+// [[Rcpp::plugins(cpp20)]]
+
+#include <Rcpp.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../../inst/include/blofeld/utilities/samplers.h"
+
+// R's RNG via R::rbinom:
+// [[Rcpp::export]]
+Rcpp::IntegerVector rbinom_r(int const draws, int const n, double const p)
+{
+  Rcpp::IntegerVector rv(draws);
+  for (int i=0; i<draws; ++i) rv[i] = static_cast<int>(R::rbinom(n, p));
+  return rv;
+}
+
+// Native sampler driven by R's unif_rand (so set.seed is respected):
+// [[Rcpp::export]]
+Rcpp::IntegerVector rbinom_native_r(int const draws, int const n, double const p)
+{
+  blofeld::Sampler sampler;
+  auto unif = []() -> double { return R::unif_rand(); };
+  Rcpp::IntegerVector rv(draws);
+  for (int i=0; i<draws; ++i) rv[i] = sampler.rbinom(unif, n, p);
+  return rv;
+}
+
+// Native sampler driven by std::mt19937:
+// [[Rcpp::export]]
+Rcpp::IntegerVector rbinom_native_mt(int const draws, int const n, double const p, int const seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> ud(0.0, 1.0);
+  auto unif = [&]() -> double { return ud(rng); };
+  blofeld::Sampler sampler;
+  Rcpp::IntegerVector rv(draws);
+  for (int i=0; i<draws; ++i) rv[i] = sampler.rbinom(unif, n, p);
+  return rv;
+}
+
+// Chi-squared goodness-of-fit of the native sampler against the binomial pmf (R::dbinom),
+// with tail cells pooled until each has an expected count of at least 5:
+// [[Rcpp::export]]
+Rcpp::DataFrame rbinom_native_gof(int const draws, int const n, double const p, int const seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> ud(0.0, 1.0);
+  auto unif = [&]() -> double { return ud(rng); };
+  blofeld::Sampler sampler;
+  std::vector<double> observed(n+1, 0.0);
+  for (int i=0; i<draws; ++i) observed[sampler.rbinom(unif, n, p)] += 1.0;
+
+  std::vector<double> obs_cells;
+  std::vector<double> exp_cells;
+  double obs = 0.0;
+  double expd = 0.0;
+  for (int k=0; k<=n; ++k) {
+    obs += observed[k];
+    expd += static_cast<double>(draws) * R::dbinom(k, n, p, false);
+    if (expd >= 5.0) {
+      obs_cells.push_back(obs);
+      exp_cells.push_back(expd);
+      obs = 0.0;
+      expd = 0.0;
+    }
+  }
+  // Any remaining upper tail joins the last cell:
+  if (!exp_cells.empty()) {
+    obs_cells.back() += obs;
+    exp_cells.back() += expd;
+  }
+
+  double statistic = 0.0;
+  for (std::size_t i=0; i<exp_cells.size(); ++i) {
+    statistic += (obs_cells[i] - exp_cells[i]) * (obs_cells[i] - exp_cells[i]) / exp_cells[i];
+  }
+  int const cells = static_cast<int>(exp_cells.size());
+  int const df = std::max(1, cells - 1);
+
+  return Rcpp::DataFrame::create(
+    Rcpp::Named("Statistic") = statistic,
+    Rcpp::Named("DF") = df,
+    Rcpp::Named("PValue") = R::pchisq(statistic, df, false, false)
+  );
+}
+
+// std::binomial_distribution constructed for every draw (as BridgeCpp used to do):
+// [[Rcpp::export]]
+Rcpp::IntegerVector rbinom_std_fresh(int const draws, int const n, double const p, int const seed)
+{
+  std::mt19937 rng(seed);
+  Rcpp::IntegerVector rv(draws);
+  for (int i=0; i<draws; ++i) {
+    std::binomial_distribution<int> d(n, p);
+    rv[i] = d(rng);
+  }
+  return rv;
+}
+
+// std::binomial_distribution constructed once:
+// [[Rcpp::export]]
+Rcpp::IntegerVector rbinom_std_reused(int const draws, int const n, double const p, int const seed)
+{
+  std::mt19937 rng(seed);
+  std::binomial_distribution<int> d(n, p);
+  Rcpp::IntegerVector rv(draws);
+  for (int i=0; i<draws; ++i) rv[i] = d(rng);
+  return rv;
+}
+
+// Equal-probability multinomial (as used by Compartment::distribute), returning a boxes x draws matrix:
+// [[Rcpp::export]]
+Rcpp::IntegerMatrix rmultinom_equal_native(int const draws, int const n, int const boxes)
+{
+  blofeld::Sampler sampler;
+  auto unif = []() -> double { return R::unif_rand(); };
+  Rcpp::IntegerMatrix rv(boxes, draws);
+  std::vector<int> out(boxes);
+  for (int i=0; i<draws; ++i) {
+    sampler.rmultinomEqual(unif, n, out);
+    for (int k=0; k<boxes; ++k) rv(k, i) = out[k];
+  }
+  return rv;
+}